@@ -24,233 +24,947 @@
 #include <string.h>
 #include <assert.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "nblist.h"
+#include "assoc_engine.h"
 
 /* how many powers of 2's worth of buckets we use */
 volatile unsigned int hashpower = HASHPOWER_DEFAULT;
 
-//Amount of collision lists
-#define hashsize(n) ((uint64_t)1<<(n))
+/* Main hash table, see assoc_engine.h for how it is segmented.
+ * What a bucket holds depends on the engine: an inline list head and
+ * chain index (nblist, below) or a cache line of tagged slots
+ * (assoc_tagged.c). */
+void *assoc_segments[MAX_SEGMENTS];
+unsigned int assoc_base_hashpower;
+//What calloc returned for each segment, segments are aligned afterwards
+static void *segment_mem[MAX_SEGMENTS];
 
-//Masks to know to what collision list an item goes to
-#define hashmask(n) (hashsize(n)-1)
+static const assoc_engine *engine;
 
-/* Main hash table. This is where we look except during expansion. */
-static List** hashtable = 0;
-static List** new_hashtable = 0; /* hash table that is being expanded into */
 
-
-/* Clock related */
-#define JOIN(a,b,c) a ## b ## c
-#define GET_CLOCK_TYPE(size) JOIN(uint, size, _t)
-#define GET_CLOCK_MAX(size) JOIN(UINT, size, _MAX)
-
-#define CLOCK_SIZE 8 //Size of each clock variable in bits
-#define CLOCK_TYPE GET_CLOCK_TYPE(CLOCK_SIZE)
-
-//#define CLOCK
-#ifdef CLOCK
-    #define CLOCK_MAX 1
-    #define INC_FACTOR 1
-    #define DEC_FACTOR 1
-#else
-    #define CLOCK_MAX GET_CLOCK_MAX(CLOCK_SIZE)
-    #define INC_FACTOR 1
-    #define DEC_FACTOR 1
-#endif
-
-static CLOCK_TYPE* clock_val = NULL;
-static CLOCK_TYPE* new_clock_val = NULL;
-static __thread uint32_t hand = 0;
+/* CLOCK hands of try_evict(), one per slab class: each sweeps the buckets
+ * ticking only the items of its class (assoc_engine.h) */
+static __thread uint32_t hand[MAX_NUMBER_OF_SLAB_CLASSES];
+unsigned int assoc_chunk_clsid;
 
 //Array with number of current items
 //  cannot be uint because one thread might add and other remove
 static int64_t* curr_items = NULL; 
 
-/* Maintenence thread  / expansion */
+/* Maintenence thread  / resizing */
 static pthread_cond_t maintenance_cond = PTHREAD_COND_INITIALIZER;
 static pthread_mutex_t maintenance_lock = PTHREAD_MUTEX_INITIALIZER;
-static volatile bool expanding = false;
 
-void assoc_init(const int hashtable_init) {
+/* Background evictor: keeps the slab classes allocations ran out of above
+ * evictor_low_wm free chunks, evicting down the classes' CLOCK rings until
+ * they have evictor_high_wm (both in percent of a slab page). Allocations
+ * then find free chunks instead of evicting themselves */
+static pthread_cond_t evictor_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t evictor_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool evictor_classes[MAX_NUMBER_OF_SLAB_CLASSES]; //Ran out of chunks once
+
+/* TinyLFU admission (settings.admission_filter): every lookup, hit or miss,
+ * counts its key in a count-min sketch of SKETCH_ROWS rows of counters up
+ * to SKETCH_MAX, each halved once every SKETCH_SAMPLE lookups per counter
+ * of a row, so that it follows what is popular lately. Lookups halve the
+ * counters in turn, a few per batch, rather than all at once.
+ * Evicted items leave their estimate behind for their slab class, and a
+ * new key of a class that evicts is only linked if its estimate is higher:
+ * otherwise it would just push out something more likely to be read */
+#define SKETCH_ROWS 4
+#define SKETCH_MAX 15
+#define SKETCH_SAMPLE 10
+#define SKETCH_BATCH 64 //Lookups a thread counts before adding them up
+static uint8_t *sketch;
+static unsigned int sketch_bits; //Of the counters of a row
+static uint64_t sketch_lookups;  //Ever counted, where the halving is at
+static __thread unsigned int sketch_pending;
+static int victim_freq[MAX_NUMBER_OF_SLAB_CLASSES]; //-1 until the class evicts
+static uint64_t admission_admitted;
+static uint64_t admission_rejected;
+
+//hashpower and the resize in progress, if any, read in a single load
+//  so that a hashpower is never paired with the wrong phase
+static uint32_t table_state;
+#define STATE_RESIZING  1
+#define STATE_SHRINKING 2 //Halving the table, instead of doubling it
+#define MAKE_STATE(power, flags) (((power) << 2) | (flags))
+//Hashpower the table is resized from, and to
+#define STATE_POWER(s) ((s) >> 2)
+#define STATE_NEW_POWER(s) (!((s) & STATE_RESIZING) ? STATE_POWER(s) : \
+    ((s) & STATE_SHRINKING) ? STATE_POWER(s) - 1 : STATE_POWER(s) + 1)
+//The larger of the two, whose buckets hold both tables' items
+#define STATE_MAX_POWER(s) (((s) & STATE_SHRINKING) ? STATE_POWER(s) : STATE_NEW_POWER(s))
+
+/* While resizing, the old buckets whose items may move (all of them when
+ * expanding, the upper half when shrinking) are split in ranges of
+ * MIGRATE_RANGE buckets, claimed in order by workers (one range per insert)
+ * and by the maintenance thread. Until its range is done, an item that
+ * moves may still be in its old bucket.
+ * Operations register in a range to use its old buckets, and a range is
+ * only migrated once none is left: moved nodes would take traversals of
+ * the old buckets along to their new bucket. Each range is a word with the
+ * number of registered operations above its state bits. */
+#define MIGRATE_RANGE 64
+#define RANGE_PENDING   0
+#define RANGE_MIGRATING 1
+#define RANGE_DONE      2
+#define RANGE_STATE(v) ((v) & 3)
+#define RANGE_USER 4
+static uint32_t *range_state;
+static uint64_t range_base;   //First old bucket of the first range
+static uint64_t range_count;
+static uint64_t range_cursor; //Next range to claim
+static uint64_t ranges_done;
+static bool migration_open = false; //Set once every thread inserts into the new buckets
+
+//Allocates a zero filled, cache line aligned, segment of nbuckets buckets
+static void *alloc_segment(const unsigned int seg, const uint64_t nbuckets) {
+    void *mem = calloc(1, nbuckets * engine->bucket_size + ASSOC_CACHE_LINE);
+    if (!mem)
+        return NULL;
+
+    segment_mem[seg] = mem;
+    return (void*) (((uintptr_t) mem + ASSOC_CACHE_LINE - 1) & ~(uintptr_t) (ASSOC_CACHE_LINE - 1));
+}
+
+
+/* Non-blocking lists engine, every bucket is a List (nblist.c) and the
+ * chain index of the List, if lookups found it long.
+ * A lookup that walks more than settings.chain_index_len items samples
+ * every CHAIN_INDEX_STRIDE-th item of the list, in order, into an index
+ * that later lookups binary search for the item to start walking from.
+ * Indexes are immutable: one is replaced as a whole when lookups get long
+ * again, and marked stale (never used again) before any item it sampled is
+ * retired, so a list that shrinks loses it. None is used or built while
+ * resizing (items move), and migration drops those of the buckets it moves
+ * items out of. With chain_index_len 0 (the default) buckets are bare Lists,
+ * without room for an index. */
+#define CHAIN_INDEX_STRIDE 8
+//Indexes of buckets with the same b % CHAIN_INDEX_LOCKS are built and
+//  dropped under the same lock. Deletes mark them stale without it
+#define CHAIN_INDEX_LOCKS 64
+//Low bit of nblist_bucket.index: lookups must not use it, the next build
+//  or migration drops it. Set on a bucket without one too, so that an
+//  index being built is not published
+#define CHAIN_INDEX_STALE ((uintptr_t) 1)
+#define CHAIN_INDEX_PTR(idx) ((chain_index*) ((uintptr_t) (idx) & ~CHAIN_INDEX_STALE))
+
+typedef struct chain_index {
+    uint32_t n;
+    item *fingers[]; //In list order
+} chain_index;
+
+typedef struct nblist_bucket {
+    List list;
+    chain_index *index;
+} nblist_bucket;
+
+static pthread_mutex_t chain_index_locks[CHAIN_INDEX_LOCKS];
+
+//Only the List is there if indexes are disabled (nblist_init())
+static inline nblist_bucket *get_nblist_bucket(const uint64_t b) {
+    unsigned int seg = assoc_segment_of(b);
+    return (nblist_bucket*) ((char*) assoc_segments[seg] +
+        assoc_segment_offset(b, seg) * engine->bucket_size);
+}
+
+static inline List *get_bucket(const uint64_t b) {
+    return &get_nblist_bucket(b)->list;
+}
+
+//Unpublishes the index of a bucket, stale or not, with its lock held.
+//  Lookups that loaded it keep it (and its fingers) until they are
+//  quiescent. Its fingers may be retired already, and stay IDX_SAMPLED
+static void drop_chain_index(nblist_bucket *bucket, reclamation *r) {
+    chain_index *idx = CHAIN_INDEX_PTR(__atomic_exchange_n(&bucket->index, NULL, __ATOMIC_ACQ_REL));
+    if (idx == NULL)
+        return;
+
+    add_retired_item(r, (item*) idx, OS_TYPE);
+
+    STATS_LOCK();
+    stats_state.hash_chain_indexes--;
+    STATS_UNLOCK();
+}
+
+//Samples the list of bucket b into a new index, or leaves it without one
+//  if it got short. Skipped if the bucket's lock is busy
+static void build_chain_index(const uint64_t b) {
+    pthread_mutex_t *lock = &chain_index_locks[b % CHAIN_INDEX_LOCKS];
+    if (pthread_mutex_trylock(lock) != 0)
+        return;
+
+    nblist_bucket *bucket = get_nblist_bucket(b);
+    drop_chain_index(bucket, recl);
+
+    uint32_t len = 0;
+    for (item *it = (item*) get_unmarked_reference(__atomic_load_n(&bucket->list.next, __ATOMIC_ACQUIRE));
+        it != NULL; it = (item*) get_unmarked_reference(__atomic_load_n(&it->next, __ATOMIC_ACQUIRE)))
+        len++;
+
+    //Items inserted since are left out, or not indexed if the index is full
+    chain_index *idx = NULL;
+    if (len > (uint32_t) settings.chain_index_len && len >= CHAIN_INDEX_STRIDE &&
+        (idx = malloc(sizeof(chain_index) + len / CHAIN_INDEX_STRIDE * sizeof(item*))) != NULL) {
+        uint32_t walked = 0;
+        idx->n = 0;
+
+        item *it = (item*) get_unmarked_reference(__atomic_load_n(&bucket->list.next, __ATOMIC_ACQUIRE));
+        while (it != NULL && idx->n < len / CHAIN_INDEX_STRIDE) {
+            item *next = __atomic_load_n(&it->next, __ATOMIC_ACQUIRE);
+            if (!is_marked_reference(next) && ++walked % CHAIN_INDEX_STRIDE == 0) {
+                //Pairs with retire_item() (nblist.c): an item removed
+                //  meanwhile is seen marked, or its retirement sees it sampled
+                __atomic_fetch_or(&it->idx_flags, IDX_SAMPLED, __ATOMIC_RELAXED);
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                if (!is_marked_reference(__atomic_load_n(&it->next, __ATOMIC_RELAXED)))
+                    idx->fingers[idx->n++] = it;
+            }
+            it = (item*) get_unmarked_reference(next);
+        }
+
+        //An item it sampled was retired meanwhile if the bucket went stale
+        chain_index *expected = NULL;
+        if (!__atomic_compare_exchange_n(&bucket->index, &expected, idx, false,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            free(idx); //Never published
+        } else {
+            STATS_LOCK();
+            stats_state.hash_chain_indexes++;
+            STATS_UNLOCK();
+        }
+    }
+
+    pthread_mutex_unlock(lock);
+}
+
+//Where a lookup of (hv, key) starts: the last finger before it that is
+//  still in the list, or the head
+static List *chain_index_start(chain_index *idx, List *head,
+    const char *key, const size_t nkey, const uint32_t hv) {
+    uint32_t lo = 0, hi = idx->n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (HKEY_cmp(idx->fingers[mid], key, nkey, hv) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    //Fingers removed from the list are not retired while idx is not stale
+    while (lo > 0) {
+        item *it = idx->fingers[--lo];
+        if (!is_marked_reference(__atomic_load_n(&it->next, __ATOMIC_ACQUIRE)))
+            return (List*) it;
+    }
+    return head;
+}
+
+//Marks the index of the bucket(s) of it stale, before it is retired.
+//  Lookups that loaded the index before are quiescent before it is freed.
+//  Only items an index sampled get here, so buckets do have one
+void nblist_unindex(item *it) {
+    uint32_t state = __atomic_load_n(&table_state, __ATOMIC_ACQUIRE);
+    uint64_t b = it->hv & hashmask(STATE_POWER(state));
+    uint64_t new_b = it->hv & hashmask(STATE_NEW_POWER(state));
+
+    //While resizing, the item may be sampled in either of its buckets
+    __atomic_fetch_or((uintptr_t*) &get_nblist_bucket(b)->index, CHAIN_INDEX_STALE,
+        __ATOMIC_ACQ_REL);
+    if (new_b != b)
+        __atomic_fetch_or((uintptr_t*) &get_nblist_bucket(new_b)->index, CHAIN_INDEX_STALE,
+            __ATOMIC_ACQ_REL);
+}
+
+static item *nblist_find(const uint64_t b, const unsigned int power,
+    const char *key, const size_t nkey, const uint32_t hv) {
+    nblist_bucket *bucket = get_nblist_bucket(b);
+    List *start = &bucket->list;
+    unsigned int walked;
+
+    //Lookups that see no resize finish before migration starts
+    bool resizing = __atomic_load_n(&table_state, __ATOMIC_ACQUIRE) & STATE_RESIZING;
+    if (settings.chain_index_len > 0 && !resizing) {
+        chain_index *idx = __atomic_load_n(&bucket->index, __ATOMIC_ACQUIRE);
+        if (idx != NULL && !((uintptr_t) idx & CHAIN_INDEX_STALE))
+            start = chain_index_start(idx, start, key, nkey, hv);
+    }
+
+    //Only writers unlink deleted items, hot buckets stay shared in caches
+    item *it = get_readonly(start, key, nkey, hv, &walked);
+
+    if (settings.chain_index_len > 0 && walked > (unsigned int) settings.chain_index_len && !resizing)
+        build_chain_index(b);
+    return it;
+}
+
+static bool nblist_insert(const uint64_t b, const unsigned int power,
+    item *it, const uint32_t hv) {
+    return insert(get_bucket(b), it);
+}
+
+static bool nblist_delete(const uint64_t b, const unsigned int power,
+    const char *key, const size_t nkey, const uint32_t hv, bool *found) {
+    return del(get_bucket(b), key, nkey, hv, true, found) != NULL;
+}
+
+static bool nblist_delete_item(const uint64_t b, const unsigned int power,
+    item *it, const uint32_t hv) {
+    bool found = false;
+    del_by_ref(get_bucket(b), it, true, &found);
+    return found;
+}
+
+static bool nblist_replace(const uint64_t b, const unsigned int power,
+    item *old_it, item *new_it, const uint32_t hv) {
+    List *l = get_bucket(b);
+    bool inserted = false;
+
+    //Lost to other changes of the key every time: the store starts over
+    //  or gives up (do_store_item())
+    for(int tries = 0; !inserted && tries < STORE_ITEM_RETRIES; tries++) {
+        //replace() deletes the first version after inserting new_it, which is
+        //  new_it itself if the key was not there (e.g., not migrated yet)
+        if(get(l, ITEM_key(old_it), old_it->nkey, hv) == NULL && insert(l, new_it))
+            return true;
+
+        replace(l, ITEM_key(old_it), old_it->nkey, hv, new_it, true, &inserted);
+    }
+
+    return inserted;
+}
+
+static bool nblist_replace_if(const uint64_t b, const unsigned int power,
+    item *old_it, item *new_it, const uint32_t hv) {
+    return replace_if(get_bucket(b), old_it, new_it) != NULL;
+}
+
+//Marks the cold items, then unlinks them all in a single pass
+static int nblist_evict(const uint64_t b, const unsigned int clsid) {
+    List *l = get_bucket(b);
+    int removed = 0;
+
+    item *it = (item*) get_unmarked_reference(__atomic_load_n(&l->next, __ATOMIC_ACQUIRE));
+    while (it != list_tail(l)) {
+        item *next = __atomic_load_n(&it->next, __ATOMIC_ACQUIRE);
+        if (!is_marked_reference(next) && assoc_frees_class(it, clsid)
+            && !assoc_clock_tick(it) && mark_node(it)) {
+            assoc_evicted(it);
+            removed++;
+        }
+        it = (item*) get_unmarked_reference(next);
+    }
+
+    if (removed > 0)
+        cleanup(l);
+    return removed;
+}
+
+static void nblist_migrate_bucket(const uint64_t i, const unsigned int new_hashpower, reclamation *recl) {
+    item *head, *tail, *it, *next;
+
+    //Its items are about to move, its index would lead lookups after them
+    if (settings.chain_index_len > 0) {
+        pthread_mutex_lock(&chain_index_locks[i % CHAIN_INDEX_LOCKS]);
+        drop_chain_index(get_nblist_bucket(i), recl);
+        pthread_mutex_unlock(&chain_index_locks[i % CHAIN_INDEX_LOCKS]);
+    }
+
+    List *l = get_bucket(i); //old bucket
+    head = list_head(l);
+    tail = list_tail(l);
+
+    //Traverse items in bucket
+    for(it = head->next; it != tail; it = next) {
+        uint32_t new_bucket = it->hv & hashmask(new_hashpower);
+
+        //Read next now because if we reinser it will change
+        next = (item*) get_unmarked_reference(it->next);
+
+        if(i != new_bucket) {
+            //hash mask's left most bit changed, change item's bucket
+
+            List *new_list = get_bucket(new_bucket);
+
+            //During this time, the item is not visible
+            //There is also the chance that an item is marked and deleted
+            //  by anoter thread, deleting it permanently
+            //TODO: maybe mark the 2nd least significant bit as well
+            //  to prevent this from happening?
+
+            bool unused, ret;
+            if(del_by_ref(l, it, false, &unused)) {
+                ret = insert(new_list, it);
+
+                if(!ret) {
+                    //Item not inserted for whatever reason,
+                    //	should be safe to reclaim as it is 
+                    //	not accessible through the data structure.
+                    
+                    //TODO: test this (?)
+                    add_retired_item(recl, it, CUSTOM_TYPE);
+
+                    if(settings.verbose > 0) {
+                        printf("item %.*s, was already in %d\n",
+                            it->nkey, ITEM_key(it), new_bucket);
+                    }
+
+
+                } else if(settings.verbose > 1) {
+                    printf("Replaced item %.*s, from bucket %lu to %d\n",
+                        it->nkey, ITEM_key(it), (unsigned long) i, new_bucket);
+                }
+            }
+        }
+    }
+}
+
+static void nblist_migrate(const uint64_t first, const uint64_t last,
+    const unsigned int old_hashpower, const unsigned int new_hashpower, reclamation *recl) {
+    for(uint64_t i = first; i < last; ++i)
+        nblist_migrate_bucket(i, new_hashpower, recl);
+}
+
+static void nblist_prefetch(const uint64_t b, const unsigned int power, const uint32_t hv) {
+    item *it = (item*) get_unmarked_reference(get_bucket(b)->next);
+    if(it != NULL) {
+        __builtin_prefetch(it, 0, 3);
+        //The key may be on the next cache line
+        __builtin_prefetch(ITEM_key(it), 0, 3);
+    }
+}
+
+static assoc_engine nblist_engine;
+
+static void nblist_init(void) {
+    //Lookups never build an index, no bucket needs room for one
+    if (settings.chain_index_len == 0)
+        nblist_engine.bucket_size = sizeof(List);
+
+    if(!check_alignment()) {
+        fprintf(stderr, "Alignment of struct item and struct List differs!\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < CHAIN_INDEX_LOCKS; i++)
+        pthread_mutex_init(&chain_index_locks[i], NULL);
+
+    nblist_replace_algo = nblist_find_replace_algo(settings.replace_algo);
+    //Workers and the hash table's threads
+    nblist_init_stats(settings.num_threads + ASSOC_THREADS);
+}
+
+static assoc_engine nblist_engine = {
+    .name = "nblist",
+    .bucket_size = sizeof(nblist_bucket),
+    //1.5 items per bucket
+    .max_load_pct = 150,
+    .max_hashpower = HASHPOWER_MAX,
+    .init = nblist_init,
+    .find = nblist_find,
+    .insert = nblist_insert,
+    .delete = nblist_delete,
+    .delete_item = nblist_delete_item,
+    .replace = nblist_replace,
+    .replace_if = nblist_replace_if,
+    .evict = nblist_evict,
+    .migrate = nblist_migrate,
+    .release = NULL,
+    .prefetch = nblist_prefetch,
+};
+
+
+//About a counter per 256 bytes of memory in every row
+static void sketch_init(void) {
+    sketch_bits = 10;
+    while (sketch_bits < 30 && (1ULL << (sketch_bits + 8)) < settings.maxbytes)
+        sketch_bits++;
+    sketch = calloc(SKETCH_ROWS, (size_t) 1 << sketch_bits);
+    if (!sketch) {
+        fprintf(stderr, "Failed to allocate the admission filter\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < MAX_NUMBER_OF_SLAB_CLASSES; i++)
+        victim_freq[i] = -1;
+}
+
+//Counter of row r for hv (multiply-shift, with a different seed per row)
+static inline uint8_t *sketch_counter(const unsigned int r, const uint32_t hv) {
+    static const uint64_t seeds[SKETCH_ROWS] = {
+        0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+        0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL };
+    uint64_t h = ((uint64_t) hv ^ (seeds[r] >> 32)) * seeds[r];
+    return &sketch[((uint64_t) r << sketch_bits) + (h >> (64 - sketch_bits))];
+}
+
+static unsigned int sketch_estimate(const uint32_t hv) {
+    unsigned int min = SKETCH_MAX;
+    for (unsigned int r = 0; r < SKETCH_ROWS; r++) {
+        uint8_t v = __atomic_load_n(sketch_counter(r, hv), __ATOMIC_RELAXED);
+        if (v < min)
+            min = v;
+    }
+    return min;
+}
+
+/* Halves the counters lookups from up to to are due for, SKETCH_ROWS per
+ * SKETCH_SAMPLE lookups, so that all were halved once a period is over.
+ * Ranges of lookups do not overlap, neither do the counters they halve */
+static void sketch_age(const uint64_t from, const uint64_t to) {
+    uint64_t mask = ((uint64_t) SKETCH_ROWS << sketch_bits) - 1;
+    for (uint64_t i = from * SKETCH_ROWS / SKETCH_SAMPLE;
+            i < to * SKETCH_ROWS / SKETCH_SAMPLE; i++) {
+        uint8_t *c = &sketch[i & mask];
+        __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) >> 1, __ATOMIC_RELAXED);
+    }
+
+    //The estimates evicted items left behind age a period at a time
+    uint64_t period = (uint64_t) SKETCH_SAMPLE << sketch_bits;
+    if (from / period == to / period)
+        return;
+    for (int i = 0; i < MAX_NUMBER_OF_SLAB_CLASSES; i++) {
+        int v = __atomic_load_n(&victim_freq[i], __ATOMIC_RELAXED);
+        if (v > 0)
+            __atomic_store_n(&victim_freq[i], v >> 1, __ATOMIC_RELAXED);
+    }
+}
+
+//Counts a lookup of hv. Increments racing on a counter may be lost
+static void sketch_add(const uint32_t hv) {
+    for (unsigned int r = 0; r < SKETCH_ROWS; r++) {
+        uint8_t *c = sketch_counter(r, hv);
+        uint8_t v = __atomic_load_n(c, __ATOMIC_RELAXED);
+        if (v < SKETCH_MAX)
+            __atomic_store_n(c, v + 1, __ATOMIC_RELAXED);
+    }
+
+    if (++sketch_pending < SKETCH_BATCH)
+        return;
+    uint64_t before = __atomic_fetch_add(&sketch_lookups, sketch_pending, __ATOMIC_RELAXED);
+    sketch_age(before, before + sketch_pending);
+    sketch_pending = 0;
+}
+
+void assoc_evicted(item *it) {
+    if (sketch)
+        __atomic_store_n(&victim_freq[ITEM_clsid(it)], (int) sketch_estimate(it->hv),
+            __ATOMIC_RELAXED);
+    do_item_dropped(it);
+}
+
+/* What assoc_admit() would say of a new key of slab class id, before it
+ * is allocated. Neither counted in the stats nor a lookup */
+bool assoc_admits(const unsigned int id, const uint32_t hv) {
+    if (!sketch)
+        return true;
+    int victim = __atomic_load_n(&victim_freq[id], __ATOMIC_RELAXED);
+    return victim < 0 || (int) sketch_estimate(hv) > victim;
+}
+
+/* Whether the new key it (linked next) is worth what its class evicts to
+ * make room for it. Keys are always admitted while their class does not
+ * evict, or without settings.admission_filter */
+bool assoc_admit(const item *it, const uint32_t hv) {
+    if (!sketch)
+        return true;
+    int victim = __atomic_load_n(&victim_freq[ITEM_clsid(it)], __ATOMIC_RELAXED);
+    if (victim < 0)
+        return true;
+
+    if ((int) sketch_estimate(hv) > victim) {
+        __atomic_fetch_add(&admission_admitted, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+    __atomic_fetch_add(&admission_rejected, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+void assoc_init(const int hashtable_init, enum assoc_engine_type type) {
+    switch(type) {
+        case ASSOC_NBLIST:
+            engine = &nblist_engine;
+            break;
+        case ASSOC_TAGGED:
+            engine = &tagged_engine;
+            break;
+        case ASSOC_SOLIST:
+            engine = &solist_engine;
+            break;
+    }
+    settings.assoc_engine = engine->name;
+
     if (hashtable_init) {
         hashpower = hashtable_init;
     }
-
-    //Allocate space for hashsize lists
-    hashtable = calloc(hashsize(hashpower), sizeof(List *));
-    if (!hashtable) {
-        fprintf(stderr, "Failed to init hashtable.\n");
+    if (hashpower > engine->max_hashpower) {
+        fprintf(stderr, "The %s hash table engine supports a hashpower of up to %u\n",
+            engine->name, engine->max_hashpower);
         exit(EXIT_FAILURE);
     }
+    assoc_base_hashpower = hashpower;
+    table_state = MAKE_STATE(hashpower, 0);
+
+    if (engine->init)
+        engine->init();
 
-    //Initialize a list for each hashtable collision list
-    for (int i = 0; i < hashsize(hashpower); ++i)
-        hashtable[i] = new_nblist();
+    if (settings.admission_filter)
+        sketch_init();
+    if (strcmp(settings.evict_algo, "sieve") == 0)
+        sieve_init();
 
-    clock_val = calloc(hashsize(hashpower), sizeof(CLOCK_TYPE));
-    if (!clock_val) {
-        fprintf(stderr, "Failed to init CLOCK values.\n");
+    //Zero filled buckets are empty, no per bucket initialization
+    assoc_segments[0] = alloc_segment(0, hashsize(hashpower));
+    if (!assoc_segments[0]) {
+        fprintf(stderr, "Failed to init hashtable.\n");
         exit(EXIT_FAILURE);
     }
 
     //Allocate array that keeps track of total number of items
-    curr_items = calloc(settings.num_threads, sizeof(int64_t));
+    //  (one more for each of the hash table's threads)
+    curr_items = calloc(settings.num_threads + ASSOC_THREADS, sizeof(int64_t));
 
     STATS_LOCK();
     stats_state.hash_power_level = hashpower;
-    stats_state.hash_bytes = hashsize(hashpower) * sizeof(void *);
+    stats_state.hash_bytes = hashsize(hashpower) * engine->bucket_size;
     STATS_UNLOCK();
 }
 
-void static inline inc_clock(uint32_t bucket) {
-    CLOCK_TYPE *clock = &clock_val[bucket];
-    CLOCK_TYPE val = *clock;
-    if(val < CLOCK_MAX - INC_FACTOR) {
-        *clock = val + INC_FACTOR;
+//Whether b is an old bucket items may move from
+static inline bool in_ranges(const uint64_t b) {
+    return b >= range_base && b - range_base < range_count * MIGRATE_RANGE;
+}
+
+//Registers an operation in the old buckets of b's range, waiting for it to
+//  be migrated if it is being migrated. Returns false if it is done
+static bool enter_range(const uint64_t b) {
+    uint32_t *range = &range_state[(b - range_base) / MIGRATE_RANGE];
+    uint32_t v = __atomic_load_n(range, __ATOMIC_ACQUIRE);
+
+    while(true) {
+        if(RANGE_STATE(v) == RANGE_DONE)
+            return false;
+        if(RANGE_STATE(v) == RANGE_MIGRATING) {
+            sched_yield();
+            v = __atomic_load_n(range, __ATOMIC_ACQUIRE);
+        } else if(__atomic_compare_exchange_n(range, &v, v + RANGE_USER,
+            false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            return true;
+        }
+    }
+}
+
+static inline void leave_range(const uint64_t b) {
+    __atomic_fetch_sub(&range_state[(b - range_base) / MIGRATE_RANGE], RANGE_USER, __ATOMIC_RELEASE);
+}
+
+//Claims and migrates up to max ranges of the resize described by state
+static void migrate_ranges(const uint32_t state, uint64_t max, reclamation *r) {
+    while(max-- > 0) {
+        uint64_t range = __atomic_fetch_add(&range_cursor, 1, __ATOMIC_RELAXED);
+        if(range >= range_count)
+            return;
+
+        //Keep new operations out, and wait for the ones already in
+        __atomic_fetch_or(&range_state[range], RANGE_MIGRATING, __ATOMIC_ACQUIRE);
+        while(__atomic_load_n(&range_state[range], __ATOMIC_ACQUIRE) >= RANGE_USER)
+            sched_yield();
+
+        uint64_t first = range_base + range * MIGRATE_RANGE;
+        engine->migrate(first, first + MIGRATE_RANGE,
+            STATE_POWER(state), STATE_NEW_POWER(state), r);
+
+        __atomic_store_n(&range_state[range], RANGE_DONE, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&ranges_done, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/* Lookups while resizing, hmask being the old bucket.
+ * Until its range is done, an item that moves may still be in the old
+ * bucket, the new bucket has the newest version, if any. Items that stay
+ * are looked up with the larger power, the tagged engine may have placed
+ * them past the smaller table. */
+static item *resizing_find(const uint32_t state, const uint64_t hmask,
+    const char *key, const size_t nkey, const uint32_t hv) {
+    unsigned int power = STATE_POWER(state), new_power = STATE_NEW_POWER(state);
+    uint64_t new_hmask = hv & hashmask(new_power);
+    item *it;
+
+    if(new_hmask == hmask && !in_ranges(hmask))
+        return engine->find(hmask, STATE_MAX_POWER(state), key, nkey, hv);
+    if(!enter_range(hmask))
+        return engine->find(new_hmask, new_power, key, nkey, hv);
+
+    if(new_hmask == hmask) {
+        it = engine->find(hmask, STATE_MAX_POWER(state), key, nkey, hv);
+    } else {
+        it = engine->find(new_hmask, new_power, key, nkey, hv);
+        if(it == NULL)
+            it = engine->find(hmask, power, key, nkey, hv);
+    }
+
+    leave_range(hmask);
+    return it;
+}
+
+static int resizing_delete(const uint32_t state, const uint64_t hmask,
+    const char *key, const size_t nkey, const uint32_t hv, bool *found) {
+    unsigned int power = STATE_POWER(state), new_power = STATE_NEW_POWER(state);
+    uint64_t new_hmask = hv & hashmask(new_power);
+    int ret = 0;
+
+    if(new_hmask == hmask && !in_ranges(hmask)) {
+        //An older version placed past the shrunk table may be left (tagged engine)
+        while(engine->delete(hmask, STATE_MAX_POWER(state), key, nkey, hv, found))
+            ret = 1;
+        return ret;
+    }
+    if(!enter_range(hmask))
+        return engine->delete(new_hmask, new_power, key, nkey, hv, found);
+
+    if(new_hmask == hmask) {
+        ret = engine->delete(hmask, STATE_MAX_POWER(state), key, nkey, hv, found);
+    } else {
+        ret = engine->delete(new_hmask, new_power, key, nkey, hv, found);
+        //Older versions in the old bucket must go as well
+        ret |= engine->delete(hmask, power, key, nkey, hv, found);
+    }
+
+    leave_range(hmask);
+    return ret;
+}
+
+//Same as resizing_delete, it is in one bucket only
+static bool resizing_delete_item(const uint32_t state, const uint64_t hmask,
+    item *it, const uint32_t hv) {
+    unsigned int power = STATE_POWER(state), new_power = STATE_NEW_POWER(state);
+    uint64_t new_hmask = hv & hashmask(new_power);
+    bool ret;
+
+    if(new_hmask == hmask && !in_ranges(hmask))
+        return engine->delete_item(hmask, STATE_MAX_POWER(state), it, hv);
+    if(!enter_range(hmask))
+        return engine->delete_item(new_hmask, new_power, it, hv);
+
+    if(new_hmask == hmask) {
+        ret = engine->delete_item(hmask, STATE_MAX_POWER(state), it, hv);
     } else {
-        *clock = CLOCK_MAX;
+        ret = engine->delete_item(new_hmask, new_power, it, hv) ||
+            engine->delete_item(hmask, power, it, hv);
     }
+
+    leave_range(hmask);
+    return ret;
 }
 
-uint32_t static inline dec_clock(uint32_t bucket) {
-    CLOCK_TYPE *clock = &clock_val[bucket];
-    CLOCK_TYPE val = *clock;
-    if(val > DEC_FACTOR) {
-        *clock = val - DEC_FACTOR;
-        return val;
+//Same as resizing_delete_item, old_it is in one bucket only
+static bool resizing_replace_if(const uint32_t state, const uint64_t hmask,
+    item *old_it, item *new_it, const uint32_t hv) {
+    unsigned int power = STATE_POWER(state), new_power = STATE_NEW_POWER(state);
+    uint64_t new_hmask = hv & hashmask(new_power);
+    bool ret;
+
+    if(new_hmask == hmask && !in_ranges(hmask))
+        return engine->replace_if(hmask, STATE_MAX_POWER(state), old_it, new_it, hv);
+    if(!enter_range(hmask))
+        return engine->replace_if(new_hmask, new_power, old_it, new_it, hv);
+
+    if(new_hmask == hmask) {
+        ret = engine->replace_if(hmask, STATE_MAX_POWER(state), old_it, new_it, hv);
     } else {
-        *clock = 0;
-        return val;
+        //If it was not moved yet, new_it is moved along with the rest
+        ret = engine->replace_if(new_hmask, new_power, old_it, new_it, hv) ||
+            engine->replace_if(hmask, power, old_it, new_it, hv);
     }
+
+    leave_range(hmask);
+    return ret;
 }
 
 item *assoc_find(const char *key, const size_t nkey, const uint32_t hv) {
     item *it;
-    List *l;
     uint32_t hmask;
+    uint32_t state = __atomic_load_n(&table_state, __ATOMIC_ACQUIRE);
+    unsigned int power = STATE_POWER(state);
 
-    hmask = hv & hashmask(hashpower);
-    inc_clock(hmask);
+    hmask = hv & hashmask(power);
 
-    l = hashtable[hmask];
-    it = get(l, key, nkey);
+    if(state & STATE_RESIZING)
+        it = resizing_find(state, hmask, key, nkey, hv);
+    else
+        it = engine->find(hmask, power, key, nkey, hv);
 
-    if(expanding && it == NULL) {
-        //Look in other bucket as well, if we are expanding
-        //  and item was not in the first bucket
-        hmask = hv & hashmask(hashpower);
-        inc_clock(hmask);
-        l = new_hashtable[hmask];
-        it = get(l, key, nkey);
-    }
+    if (sketch)
+        sketch_add(hv);
 
     MEMCACHED_ASSOC_FIND(key, nkey, depth);
     return it;
 }
 
+/* Looks up n keys at once, hvs being their hashes. Every bucket is
+ * prefetched, then the first item of every bucket, before any key is
+ * looked up, so the cache misses of all keys overlap instead of being
+ * taken one key after the other. */
+void assoc_find_batch(const char **keys, const size_t *nkeys, const uint32_t *hvs,
+    const int n, item **its) {
+    uint32_t state = __atomic_load_n(&table_state, __ATOMIC_ACQUIRE);
+    unsigned int power = STATE_POWER(state);
+    int i;
+
+    //Buckets of the old table are there until the resize ends, and a
+    //  shrunk segment is not freed while we are not quiescent
+    for(i = 0; i < n; i++) {
+        uint64_t b = hvs[i] & hashmask(power);
+        unsigned int seg = assoc_segment_of(b);
+        __builtin_prefetch((char*) assoc_segments[seg] +
+            assoc_segment_offset(b, seg) * engine->bucket_size, 0, 3);
+    }
+
+    if(engine->prefetch) {
+        for(i = 0; i < n; i++)
+            engine->prefetch(hvs[i] & hashmask(power), power, hvs[i]);
+    }
+
+    for(i = 0; i < n; i++)
+        its[i] = assoc_find(keys[i], nkeys[i], hvs[i]);
+}
+
 int assoc_insert(item *it, const uint32_t hv) {
-    List *l;
     uint32_t hmask;
+    uint32_t state = __atomic_load_n(&table_state, __ATOMIC_ACQUIRE);
+    //New items go straight to the new buckets
+    unsigned int power = STATE_NEW_POWER(state);
     int ret;
 
-    if(expanding) {
-        hmask = hv & hashmask(hashpower + 1);
-        l = new_hashtable[hmask];
-        //Dont change CLOCK while expanding
-    } else {
-        hmask = hv & hashmask(hashpower);
-        l = hashtable[hmask];
-        inc_clock(hmask);
-    }
-
+    hmask = hv & hashmask(power);
 
     MEMCACHED_ASSOC_INSERT(ITEM_key(it), it->nkey);
 
-    ret = insert(l, it);
+    //Items that stay in their bucket are inserted in an old bucket
+    bool entered = (state & STATE_RESIZING) && in_ranges(hmask) && enter_range(hmask);
+    ret = engine->insert(hmask, power, it, hv);
+    if(entered)
+        leave_range(hmask);
     if(ret) {
         curr_items[tid]++;
+        if (assoc_sieve)
+            sieve_push(it);
     }
 
+    //Help the resize along, a range per insert
+    if((state & STATE_RESIZING) && __atomic_load_n(&migration_open, __ATOMIC_ACQUIRE))
+        migrate_ranges(state, 1, recl);
+
     return ret;
 }
 
 int assoc_delete(const char *key, const size_t nkey, const uint32_t hv) {
-    List *l;
     uint32_t hmask;
+    uint32_t state = __atomic_load_n(&table_state, __ATOMIC_ACQUIRE);
+    unsigned int power = STATE_POWER(state);
     int ret;
 
-    hmask = hv & hashmask(hashpower);
+    hmask = hv & hashmask(power);
 
-    //Should decrement CLOCK reference?
-    l = hashtable[hmask];
-    
     bool found = false;
-    ret = del(l, key, nkey, true, &found) != NULL;
+    if(state & STATE_RESIZING)
+        ret = resizing_delete(state, hmask, key, nkey, hv, &found);
+    else
+        ret = engine->delete(hmask, power, key, nkey, hv, &found);
 
     if(ret || found) {
         curr_items[tid]--;
+    }
 
-    } else if(expanding) {
-        //Also look in other bucket,
-        //  item was not found in first
-        hmask = hv & hashmask(hashpower + 1);
-        l = new_hashtable[hmask];
-        ret = del(l, key, nkey, true, &found) != NULL;
+    return ret;
+}
 
-        if(ret || found) {
-            curr_items[tid]--;
-        }
+/* Deletes it itself, compared by address instead of by key, so a newer
+ * item that replaced it (e.g. set while it expired) is never removed */
+int assoc_delete_item(item *it, const uint32_t hv) {
+    uint32_t state = __atomic_load_n(&table_state, __ATOMIC_ACQUIRE);
+    unsigned int power = STATE_POWER(state);
+    uint32_t hmask = hv & hashmask(power);
+    int ret;
+
+    if(state & STATE_RESIZING)
+        ret = resizing_delete_item(state, hmask, it, hv);
+    else
+        ret = engine->delete_item(hmask, power, it, hv);
+
+    if(ret) {
+        curr_items[tid]--;
     }
 
     return ret;
 }
 
 int assoc_replace(item *old_it, item *new_it, const uint32_t hv) {
-    List *l;
     uint32_t hmask;
-    bool inserted;
+    uint32_t state = __atomic_load_n(&table_state, __ATOMIC_ACQUIRE);
+    unsigned int power = STATE_POWER(state);
+    int ret;
 
-    if(expanding) {
-        //TODO: Think about how expansion could mess this up!
-        hmask = hv & hashmask(hashpower + 1);
-        l = new_hashtable[hmask];
-        //Dont change CLOCK while expanding
+    //The key stays as hot as it was
+    new_it->clock_ref = old_it->clock_ref;
+    assoc_clock_bump(new_it);
 
+    if(!(state & STATE_RESIZING)) {
+        hmask = hv & hashmask(power);
+        ret = engine->replace(hmask, power, old_it, new_it, hv);
     } else {
-        hmask = hv & hashmask(hashpower);
-        l = hashtable[hmask];
-        inc_clock(hmask);
-    }
+        unsigned int new_power = STATE_NEW_POWER(state);
+        hmask = hv & hashmask(power);
+        uint64_t new_hmask = hv & hashmask(new_power);
 
-retry:
-
-    replace(l, ITEM_key(old_it), old_it->nkey, new_it, true, &inserted);
-
-    if(!inserted) {
-		goto retry;
+        if(!in_ranges(hmask) || !enter_range(hmask)) {
+            ret = engine->replace(new_hmask, new_power, old_it, new_it, hv);
+        } else {
+            ret = engine->replace(new_hmask, new_power, old_it, new_it, hv);
+            //The version being replaced may not have been moved yet
+            if(new_hmask != hmask) {
+                bool found = false;
+                engine->delete(hmask, power, ITEM_key(old_it), old_it->nkey, hv, &found);
+            }
+            leave_range(hmask);
+        }
     }
 
-    return inserted;
+    if(ret && assoc_sieve)
+        sieve_push(new_it);
+    return ret;
 }
 
-void assoc_bump(item *it, const uint32_t hv) {
-    uint32_t hmask;
-    hmask = hv & hashmask(hashpower);
-    inc_clock(hmask);
+/* Replaces old_it itself, compared by address, with new_it. Fails if
+ * old_it was replaced or removed since it was looked up, so that e.g. a
+ * cas that matched old_it does not overwrite someone else's newer item */
+int assoc_replace_if(item *old_it, item *new_it, const uint32_t hv) {
+    uint32_t state = __atomic_load_n(&table_state, __ATOMIC_ACQUIRE);
+    unsigned int power = STATE_POWER(state);
+    uint32_t hmask = hv & hashmask(power);
 
-    //Dont change CLOCK while expanding
+    new_it->clock_ref = old_it->clock_ref;
+    assoc_clock_bump(new_it);
+
+    int ret;
+    if(state & STATE_RESIZING)
+        ret = resizing_replace_if(state, hmask, old_it, new_it, hv);
+    else
+        ret = engine->replace_if(hmask, power, old_it, new_it, hv);
 
-    //assoc_delete(ITEM_key(it), it->nkey, hv);
-    //assoc_insert(it, hv);    
+    if(ret && assoc_sieve)
+        sieve_push(new_it);
+    return ret;
+}
+
+bool assoc_bump(item *it, const uint32_t hv) {
+    return assoc_clock_bump(it);
 }
 
 
 /* Returns number of items removed. */
 int try_evict(const int orig_id, const uint64_t total_bytes, const rel_time_t max_age) {
-    List *l;
-
     //Slab where we wanted to alloc (and therefore called this function)
     int id = orig_id; 
     if (id == 0)
@@ -258,36 +972,48 @@ int try_evict(const int orig_id, const uint64_t total_bytes, const rel_time_t ma
 
     size_t removed = 0;
 
-    size_t num_buckets = hashsize(hashpower);
+    //Read by assoc_frees_class() from now on
+    assoc_chunk_class();
+    if (assoc_sieve)
+        return sieve_evict(id);
+
+    uint32_t state = __atomic_load_n(&table_state, __ATOMIC_ACQUIRE);
+    size_t num_buckets = hashsize(STATE_POWER(state));
+    uint32_t *h = &hand[id];
 
     uint32_t c = 0;
     while(c++ < num_buckets) { //Do one trip around every bucket at maximum
-        hand = (hand + 1) % num_buckets;
-
-        //Update this bucket's clock val
-        if(dec_clock(hand) == 0) {
-            l = hashtable[hand];
-
-            //Only try to evict non-empty buckets
-            //if(is_empty(l)) { continue; }
-
-            //Try to pop off bucket head
-            removed = empty_list(l);
-
-            //If no one removed list might of been empty or removal failed
-            if(removed > 0) {
-                curr_items[tid] -= removed; 
-                return removed;
-            }
+        *h = (*h + 1) % num_buckets;
+
+        //Tick the bucket's items, not while they are being moved
+        bool entered = (state & STATE_RESIZING) && in_ranges(*h) && enter_range(*h);
+        removed = engine->evict(*h, id);
+        if(entered)
+            leave_range(*h);
+
+        //Every item of the class there was used lately, or there is none
+        if(removed > 0) {
+            curr_items[tid] -= removed; 
+            return removed;
         }
     }
 
     return removed;
 }
 
+void assoc_item_dropped(item *it, const bool evicted) {
+    curr_items[tid]--;
+    if (evicted) {
+        assoc_evicted(it);
+        item_stats_evictions(ITEM_clsid(it), 1, false);
+    } else {
+        do_item_dropped(it);
+    }
+}
+
 uint64_t get_curr_items() {
     int64_t res = 0;
-    for(int i = 0; i < settings.num_threads; i++)
+    for(int i = 0; i < settings.num_threads + ASSOC_THREADS; i++)
         res += curr_items[i];
     return (uint64_t) res;
 }
@@ -304,65 +1030,200 @@ int start_assoc_maintenance_thread(ebr *r) {
     return 0;
 }
 
-/* Check if we should expand hash table */
+//1 if the hash table should grow, -1 if it should shrink, 0 otherwise
+static int resize_wanted(void) {
+    uint64_t curr = get_curr_items();
+    uint64_t size = hashsize(hashpower);
+
+    /* If there are more items per bucket than the engine is meant to hold, expand */
+    if (curr * 100 > size * engine->max_load_pct && hashpower < engine->max_hashpower)
+        return 1;
+    /* If it is mostly empty, halve it, down to the size it started with */
+    if (curr * 100 < size * settings.hash_shrink_pct && hashpower > assoc_base_hashpower)
+        return -1;
+    return 0;
+}
+
+//Replacement counts of the nblist engine, zero for the others
+void assoc_replace_stats(ADD_STAT add_stats, void *c) {
+    replace_stats totals;
+    nblist_replace_stats(&totals);
+    APPEND_STAT("replace_retries", "%llu", (unsigned long long)totals.retries);
+    APPEND_STAT("replace_waits", "%llu", (unsigned long long)totals.waits);
+    APPEND_STAT("list_helps", "%llu", (unsigned long long)totals.helps);
+}
+
+void assoc_admission_stats(ADD_STAT add_stats, void *c) {
+    APPEND_STAT("admission_admitted", "%llu",
+        (unsigned long long)__atomic_load_n(&admission_admitted, __ATOMIC_RELAXED));
+    APPEND_STAT("admission_rejected", "%llu",
+        (unsigned long long)__atomic_load_n(&admission_rejected, __ATOMIC_RELAXED));
+}
+
+/* Check if we should resize hash table */
 void assoc_check_expand() {
     if (pthread_mutex_trylock(&maintenance_lock) == 0) {
-        uint64_t curr = get_curr_items();
-
-        /* If there are 1.5 more items than there are buckets, expand */
-        if (curr > (hashsize(hashpower) * 3) / 2 && hashpower < HASHPOWER_MAX) {
+        if (resize_wanted() != 0) {
             pthread_cond_signal(&maintenance_cond);
         }
         pthread_mutex_unlock(&maintenance_lock);
     }
 }
 
+//Sets up the ranges of a resize that moves items of buckets
+//  [first, first + count), returns false if out of memory
+static bool init_ranges(const uint64_t first, const uint64_t count) {
+    uint32_t *new_range_state = calloc(count / MIGRATE_RANGE, sizeof(uint32_t));
+    if (!new_range_state)
+        return false;
+
+    range_state = new_range_state;
+    range_base = first;
+    range_count = count / MIGRATE_RANGE;
+    range_cursor = 0;
+    ranges_done = 0;
+    return true;
+}
+
 void start_expansion() {
     unsigned int old_hashpower = hashpower;
     unsigned int new_hashpower = old_hashpower + 1;
+    //Segment that holds the upper half of the expanded table,
+    //  which has as many buckets as the current table
+    unsigned int seg = new_hashpower - assoc_base_hashpower;
+
+    if (engine->migrate != NULL && !init_ranges(0, hashsize(old_hashpower)))
+        return;
 
-    new_clock_val = calloc(hashsize(new_hashpower), sizeof(CLOCK_TYPE));
-    if (new_clock_val) {
-        //Copy CLOCK values to new buckets
-        for (unsigned int i = hashsize(hashpower); i < hashsize(new_hashpower); ++i) {
-            unsigned int clock_counterpart = i - hashsize(hashpower);
-            new_clock_val[i] = clock_val[clock_counterpart];
+    //Zero filled buckets are empty, existing buckets stay where they are
+    void *new_buckets = alloc_segment(seg, hashsize(old_hashpower));
+    if (new_buckets) {
+        assoc_segments[seg] = new_buckets;
+
+        if (engine->migrate == NULL) {
+            //Nothing to move, the new buckets just have to be visible
+            //  before the hashpower that reaches them
+            hashpower = new_hashpower;
+            __atomic_store_n(&table_state, MAKE_STATE(new_hashpower, 0), __ATOMIC_RELEASE);
+
+            STATS_LOCK();
+            stats_state.hash_power_level = new_hashpower;
+            stats_state.hash_bytes = hashsize(new_hashpower) * engine->bucket_size;
+            STATS_UNLOCK();
+
+            if(settings.verbose > 0)
+                fprintf(stderr, "Expanded from %d to %d\n", old_hashpower, new_hashpower);
+            return;
         }
 
+        //Threads can now insert into new hash table
+        __atomic_store_n(&table_state, MAKE_STATE(old_hashpower, STATE_RESIZING), __ATOMIC_RELEASE);
+
+        STATS_LOCK();
+        stats_state.hash_is_expanding = true;
+        STATS_UNLOCK();
+
+        if(settings.verbose > 0)
+            fprintf(stderr, "Starting expansion from %d to %d\n", old_hashpower, new_hashpower);
+    } else if (engine->migrate != NULL) {
+        free(range_state);
+    }
+}
+
+//Halves the table, its upper half is released once no one uses it
+static void start_shrink(void) {
+    unsigned int old_hashpower = hashpower;
+    unsigned int new_hashpower = old_hashpower - 1;
+
+    if (engine->migrate == NULL) {
+        //Nothing to move, every item is reachable from the lower half
+        hashpower = new_hashpower;
+        __atomic_store_n(&table_state, MAKE_STATE(new_hashpower, 0), __ATOMIC_RELEASE);
     } else {
-        return;
+        //Items of the upper half move down
+        if (!init_ranges(hashsize(new_hashpower), hashsize(new_hashpower)))
+            return;
+        __atomic_store_n(&table_state,
+            MAKE_STATE(old_hashpower, STATE_RESIZING | STATE_SHRINKING), __ATOMIC_RELEASE);
     }
 
-    //Allocate space for hashsize lists
-    new_hashtable = calloc(hashsize(new_hashpower), sizeof(List *));
-    if (new_hashtable) {
+    if(settings.verbose > 0)
+        fprintf(stderr, "Starting shrink from %d to %d\n", old_hashpower, new_hashpower);
+}
 
-        //Transfer existing buckets to new hashtable
-        for (unsigned int i = 0; i < hashsize(old_hashpower); ++i)
-            new_hashtable[i] = hashtable[i];
 
-        //Create new buckets
-        for (unsigned int i = hashsize(old_hashpower); i < hashsize(new_hashpower); ++i)
-            new_hashtable[i] = new_nblist();
+#define ASSOC_MAINTENENCE_THREAD_SLEEP 10000
 
-        //Threads can now insert into new hash table
-        //If we incremented hashpower here, then there might be threads
-        //  that see that the table is expanding but do not see new hashpower
-        //  (because those operations are not atomic). So, threads should calculate
-        //  the new hashpower themselves if they observe that an expansion is occurring
-        expanding = true;
+//Waits for two epochs, after which no thread is in the middle of an
+//  operation that started before the call
+static void wait_epochs(ebr *r, reclamation *recl) {
+    uint64_t curr_epoch = r->curr_epoch;
+    while(r->curr_epoch < curr_epoch + 2) {
+        announce_epoch(recl);
+        enter_quiescent(recl);
+        usleep(ASSOC_MAINTENENCE_THREAD_SLEEP);
+    }
+}
 
-        //TODO: lookups and deletes must be done in both "hashpowers" during expansion
-    
-        if(settings.verbose > 0)
-            fprintf(stderr, "Starting expansion from %d to %d\n", hashpower, hashpower + 1);
-    } else {
-        free(new_clock_val);
+//Moves the items of the resize that was started, along with the workers
+static void migrate_table(ebr *r, reclamation *recl) {
+    uint32_t state = table_state;
+    unsigned int new_hashpower = STATE_NEW_POWER(state);
+
+    //Wait for two epochs, so that no thread thinks the
+    //  old hashtable is the current hashtable and inserts
+    //  new items there
+    wait_epochs(r, recl);
+
+    //Old buckets can be migrated now, workers claim ranges as well
+    __atomic_store_n(&migration_open, true, __ATOMIC_RELEASE);
+
+    leave_quiescent(recl);
+    migrate_ranges(state, UINT64_MAX, recl);
+    enter_quiescent(recl);
+
+    //Every range is claimed, wait for the workers still migrating theirs
+    while(__atomic_load_n(&ranges_done, __ATOMIC_ACQUIRE) < range_count) {
+        announce_epoch(recl);
+        enter_quiescent(recl);
+        usleep(ASSOC_MAINTENENCE_THREAD_SLEEP / 10);
     }
+
+    //Finish resizing
+    //Buckets are not swapped, segments are only added or released
+    __atomic_store_n(&migration_open, false, __ATOMIC_RELAXED);
+    hashpower = new_hashpower;
+    __atomic_store_n(&table_state, MAKE_STATE(new_hashpower, 0), __ATOMIC_RELEASE);
+
+    //Operations that still see the resize may read it
+    leave_quiescent(recl);
+    add_retired_item(recl, (void*) range_state, OS_TYPE);
+
+	//Try and advance 2 epochs again, so that 
+	//	we reclaim any items that we might of retired
+	//	during the hash table process (and no operation
+	//	that saw this resize is left for the next one)
+    wait_epochs(r, recl);
+    enter_quiescent(recl);
 }
 
+//Frees the segment above the table after it shrank
+static void release_segment(ebr *r, reclamation *recl) {
+    unsigned int seg = hashpower + 1 - assoc_base_hashpower;
 
-#define ASSOC_MAINTENENCE_THREAD_SLEEP 10000
+    //No operation that started before the shrink is left
+    wait_epochs(r, recl);
+
+    leave_quiescent(recl);
+    if (engine->release)
+        engine->release(hashsize(hashpower), hashsize(hashpower + 1));
+
+    //Threads that still traverse them (e.g., solist dummies) are not done yet
+    assoc_segments[seg] = NULL;
+    add_retired_item(recl, segment_mem[seg], OS_TYPE);
+    segment_mem[seg] = NULL;
+    enter_quiescent(recl);
+}
 
 void *assoc_maintenance_thread(void *arg) {
     tid = settings.num_threads;
@@ -372,120 +1233,178 @@ void *assoc_maintenance_thread(void *arg) {
 
     //Required for cond signal to work (and unlock this)
     mutex_lock(&maintenance_lock);
-    bool expanded_last_iter = false;
 
     while(true) {
+        //Resize at most once per signal
+        pthread_cond_wait(&maintenance_cond, &maintenance_lock);
 
-        //Do not expand twice in a row (without waiting for cond)
-        if(expanding && !expanded_last_iter) {
-            expanded_last_iter = true;
-
-            //Wait for two epochs, so that no thread thinks the
-            //  old hashtable is the current hashtable and inserts
-            //  new items there
-            uint64_t curr_epoch = r->curr_epoch;
-            while(r->curr_epoch < curr_epoch + 2) {
-                announce_epoch(recl);
-                enter_quiescent(recl);
-                usleep(ASSOC_MAINTENENCE_THREAD_SLEEP);
-            }
+        unsigned int old_hashpower = hashpower;
+        int wanted = resize_wanted();
+        if(wanted > 0)
+            start_expansion();
+        else if(wanted < 0)
+            start_shrink();
+
+        if(table_state & STATE_RESIZING)
+            migrate_table(r, recl);
+        if(hashpower == old_hashpower)
+            continue; //Nothing to do, or out of memory
+        if(hashpower < old_hashpower)
+            release_segment(r, recl);
+
+        STATS_LOCK();
+        stats_state.hash_power_level = hashpower;
+        stats_state.hash_bytes = hashsize(hashpower) * engine->bucket_size;
+        stats_state.hash_is_expanding = false;
+        STATS_UNLOCK();
+
+        if(settings.verbose > 0) {
+            fprintf(stderr, "Resize ended, hashpower is %u\n", hashpower);
+        }
+    }
 
-            int old_hashpower = hashpower;
-            int old_hashsize = hashsize(old_hashpower);
-
-            leave_quiescent(recl);
-
-            for(uint32_t i = 0; i < old_hashsize; ++i) {
-                item *head, *tail, *it, *next;
-
-                List *l = hashtable[i]; //old hash table
-                head = l->head;
-                tail = l->tail;
-                
-                //Traverse items in bucket
-                for(it = head->next; it != tail; it = next) {
-                    char *key = ITEM_key(it);
-                    uint8_t size = it->nkey;
-                    uint32_t item_hash = hash(key, size);
-                    uint32_t new_bucket = item_hash & hashmask(old_hashpower + 1);
-
-                    //Read next now because if we reinser it will change
-                    next = (item*) get_unmarked_reference(it->next);
-
-                    if(i != new_bucket) {
-                        //hash mask's left most bit is not 0, change item's bucket
-
-                        List *new_list = new_hashtable[new_bucket];
-
-                        //During this time, the item is not visible
-                        //There is also the chance that an item is marked and deleted
-                        //  by anoter thread, deleting it permanently
-                        //TODO: maybe mark the 2nd least significant bit as well
-                        //  to prevent this from happening?
-
-                        bool unused, ret;
-                        if(del(l, key, size, false, &unused)) { //TODO: This can be optimized, we already searched
-                            ret = insert(new_list, it);
-
-							if(!ret) {
-								//Item not inserted for whatever reason,
-								//	should be safe to reclaim as it is 
-								//	not accessible through the data structure.
-								
-								//TODO: test this (?)
-       							add_retired_item(recl, it, CUSTOM_TYPE);
- 
-                            	if(settings.verbose > 0) {
-                            	    printf("item %.*s, was already in %d\n",
-                            	        it->nkey, ITEM_key(it), new_bucket);
-                            	}
-
-
-							} else if(settings.verbose > 1) {
-                                printf("Replaced item %.*s, from bucket %d to %d\n",
-                                    it->nkey, ITEM_key(it), i, new_bucket);
-                            }
-                        }
-                    }
-                }
+    mutex_unlock(&maintenance_lock);
+    return NULL;
+}
 
-            }
+//An allocation of class id found no free chunk
+void assoc_evictor_want(const unsigned int id) {
+    if (!__atomic_load_n(&evictor_classes[id], __ATOMIC_RELAXED))
+        __atomic_store_n(&evictor_classes[id], true, __ATOMIC_RELAXED);
+    if (pthread_mutex_trylock(&evictor_lock) == 0) {
+        pthread_cond_signal(&evictor_cond);
+        pthread_mutex_unlock(&evictor_lock);
+    }
+}
 
-            //Finish expanding
-            //TODO: is this safe? The OS should not care
-            add_retired_item(recl, (void*) hashtable, OS_TYPE);
-            add_retired_item(recl, (void*) clock_val, OS_TYPE);
-
-            hashtable = new_hashtable;
-            clock_val = new_clock_val;
-
-			//Try and advance 2 epochs again, so that 
-			//	we reclaim the hash table, the clock values
-			//	and any items that we might of retired
-			//	during the hash table process
-			curr_epoch = r->curr_epoch;
-            while(r->curr_epoch < curr_epoch + 2) {
-                announce_epoch(recl);
-                enter_quiescent(recl);
-                usleep(ASSOC_MAINTENENCE_THREAD_SLEEP);
-            }
+//Free chunks of watermark pct for a class with perslab chunks per page
+static unsigned int evictor_mark(const unsigned int perslab, const int pct) {
+    unsigned int n = (uint64_t) perslab * pct / 100;
+    return n > 0 ? n : 1;
+}
 
-            enter_quiescent(recl);
+#define ASSOC_EVICTOR_RECLAIM_TRIES 1000
 
-            expanding = false;
-            hashpower++;
+//Victims of each class that may not be back in the slabs yet. Evictor only
+static unsigned int evictor_pending[MAX_NUMBER_OF_SLAB_CLASSES];
 
-            if(settings.verbose > 0) {
-                fprintf(stderr, "Expansion ended\n");
-            }
+//Chunks class id gets back once the evictor's limbo is reclaimed. Every
+//  victim gives back a chunk at least
+static unsigned int evictor_unreclaimed(const unsigned int id) {
+    uint64_t retired = ebr_count_retired();
+    if (retired == 0) {
+        memset(evictor_pending, 0, sizeof(evictor_pending));
+        return 0;
+    }
+    return evictor_pending[id] < retired ? evictor_pending[id] : retired;
+}
 
-        } else {
-            expanded_last_iter = false;
-            pthread_cond_wait(&maintenance_cond, &maintenance_lock);
-            start_expansion();
+//Evicts from class id until it has high free chunks, counting the victims
+//  not reclaimed yet, or no item of it is cold. Returns how many items were
+//  evicted
+static uint64_t evictor_fill(const unsigned int id, const unsigned int high) {
+    uint64_t total = 0;
+    unsigned int avail;
+
+    while ((avail = slabs_available_chunks(id, NULL, NULL) + evictor_unreclaimed(id)) < high) {
+        unsigned int evicted = 0;
+        while (evicted < high - avail) {
+            //Workers waiting for memory cannot advance the epoch while the
+            //  evictor lags behind it, announce before every sweep
+            ebr_announce_epoch();
+            int n = try_evict(id, 0, 0);
+            if (n == 0)
+                break;
+            evicted += n;
+        }
+        evictor_pending[id] += evicted;
+        total += evicted;
+
+        //Back to the slabs before looking again. Only the evictor can
+        //  reclaim its victims, and a worker in the middle of its commands
+        //  holds the epoch back: retry a while, or allocations waiting for
+        //  them would find nothing to evict and fail. If they stay retired
+        //  (items held by responses) they still count as available above
+        for (int i = 0; evicted > 0 && i < ASSOC_EVICTOR_RECLAIM_TRIES; i++) {
+            ebr_reclaim_retired();
+            if (!ebr_has_retired())
+                break;
+            ebr_enter_quiescent();
+            sched_yield();
         }
+        ebr_enter_quiescent();
+
+        if (evicted == 0)
+            break;
     }
 
-    mutex_unlock(&maintenance_lock);
+    return total;
+}
+
+#define ASSOC_EVICTOR_SLEEP 10000
+#define ASSOC_EVICTOR_BAG_SIZE 100 //Retires about as much as a worker
+
+static void *assoc_evictor_thread(void *arg) {
+    tid = settings.num_threads + 1;
+    recl = init_reclamation((ebr*) arg, tid, ASSOC_EVICTOR_BAG_SIZE);
+    ebr_enter_quiescent();
+
+    mutex_lock(&evictor_lock);
+    while(true) {
+        bool busy = false;
+
+        sieve_sweep();
+
+        //Victims of earlier rounds that could not be reclaimed then
+        if (ebr_has_retired()) {
+            ebr_reclaim_retired();
+            ebr_enter_quiescent();
+        }
+
+        for (unsigned int id = POWER_SMALLEST; id < MAX_NUMBER_OF_SLAB_CLASSES; id++) {
+            //-M: allocations run out of memory instead
+            if (!settings.evict_to_free
+                || !__atomic_load_n(&evictor_classes[id], __ATOMIC_RELAXED))
+                continue;
+
+            //Only once the class cannot get more pages
+            bool limit;
+            unsigned int perslab;
+            unsigned int avail = slabs_available_chunks(id, &limit, &perslab)
+                + evictor_unreclaimed(id);
+            if (!limit || avail >= evictor_mark(perslab, settings.evictor_low_wm))
+                continue;
+
+            uint64_t n = evictor_fill(id, evictor_mark(perslab, settings.evictor_high_wm));
+            item_stats_evictions(id, n, true);
+            busy |= n > 0;
+        }
+
+        //Right away if it could not keep up, allocations wake it up too
+        if (!busy) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += ASSOC_EVICTOR_SLEEP * 1000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&evictor_cond, &evictor_lock, &ts);
+        }
+    }
+
+    mutex_unlock(&evictor_lock);
     return NULL;
 }
+
+int start_assoc_evictor_thread(ebr *r) {
+    int ret;
+    pthread_t thread;
+
+    if((ret = pthread_create(&thread, NULL, assoc_evictor_thread, (void*) r)) != 0) {
+        fprintf(stderr, "Failed to start evictor thread: %s\n", strerror(ret));
+        return -1;
+    }
+
+    return 0;
+}
@@ -1,18 +1,39 @@
 /* associative array */
-void assoc_init(const int hashpower_init);
+enum assoc_engine_type {
+    ASSOC_NBLIST=0, ASSOC_TAGGED, ASSOC_SOLIST
+};
+
+void assoc_init(const int hashpower_init, enum assoc_engine_type type);
 
 item *assoc_find(const char *key, const size_t nkey, const uint32_t hv);
+void assoc_find_batch(const char **keys, const size_t *nkeys, const uint32_t *hvs,
+    const int n, item **its);
 int assoc_insert(item *item, const uint32_t hv);
 int assoc_delete(const char *key, const size_t nkey, const uint32_t hv);
+int assoc_delete_item(item *it, const uint32_t hv);
 
 int assoc_replace(item *old_it, item *new_it, const uint32_t hv);
-void assoc_bump(item *it, const uint32_t hv);
+int assoc_replace_if(item *old_it, item *new_it, const uint32_t hv);
+bool assoc_bump(item *it, const uint32_t hv);
 int try_evict(const int orig_id, const uint64_t total_bytes, const rel_time_t max_age);
 
 uint64_t get_curr_items(void);
 
+//Threads of the hash table, with the tids after the workers': the
+//  maintenance thread (num_threads), the evictor (num_threads + 1) and
+//  the slab mover (num_threads + 2), which moves items between pages
+#define ASSOC_THREADS 3
+
 int start_assoc_maintenance_thread(ebr *r);
+int start_assoc_evictor_thread(ebr *r);
+void assoc_evictor_want(const unsigned int id);
 void assoc_check_expand(void);
+void assoc_replace_stats(ADD_STAT add_stats, void *c);
+bool assoc_admits(const unsigned int id, const uint32_t hv);
+bool assoc_admit(const item *it, const uint32_t hv);
+extern bool assoc_sieve;
+bool assoc_sieve_release(item *it);
+void assoc_admission_stats(ADD_STAT add_stats, void *c);
 void *assoc_maintenance_thread(void *arg);
 void start_expansion(void);
 
@@ -0,0 +1,158 @@
+/* Hash table engines, internal to the assoc*.c files */
+#ifndef ASSOC_ENGINE_H
+#define ASSOC_ENGINE_H
+
+#include "memcached.h"
+#include "ebr.h"
+
+//Amount of buckets
+#define hashsize(n) ((uint64_t)1<<(n))
+//Masks to know to what bucket an item goes to
+#define hashmask(n) (hashsize(n)-1)
+
+//Segments are aligned to this, so buckets that fill a cache line
+//  do not straddle two of them
+#define ASSOC_CACHE_LINE 64
+
+/* Buckets are stored in segments: segment 0 holds the first
+ * hashsize(assoc_base_hashpower) buckets and every expansion appends a
+ * segment as large as the whole table before it, shrinking releases the
+ * last one. Resizing the table therefore never copies or moves existing
+ * buckets, and every segment is zero filled (calloc'ed), so allocating one
+ * does not depend on its size.
+ * Engines must treat a zero filled bucket as an empty bucket. */
+#define MAX_SEGMENTS (HASHPOWER_MAX + 1)
+extern void *assoc_segments[MAX_SEGMENTS];
+extern unsigned int assoc_base_hashpower;
+
+//Segment that holds bucket b
+static inline unsigned int assoc_segment_of(const uint64_t b) {
+    if (b < hashsize(assoc_base_hashpower))
+        return 0;
+    //Segment k >= 1 holds buckets [2^(base + k - 1), 2^(base + k))
+    return (63 - __builtin_clzll(b)) - assoc_base_hashpower + 1;
+}
+
+//Offset of bucket b inside its segment
+static inline uint64_t assoc_segment_offset(const uint64_t b, const unsigned int seg) {
+    return seg == 0 ? b : b - hashsize(assoc_base_hashpower + seg - 1);
+}
+
+/* Operations of a hash table engine.
+ * Buckets are addressed by index (b) together with the hashpower the index
+ * was computed with, engines that place items outside of their home bucket
+ * need it to know where the table ends. */
+typedef struct assoc_engine assoc_engine;
+struct assoc_engine {
+    const char *name;
+    //May depend on the settings, init sets it then
+    size_t bucket_size;
+    //Expand when there are more than max_load_pct items per 100 buckets
+    unsigned int max_load_pct;
+    unsigned int max_hashpower;
+
+    //Called once at startup, before the table is allocated (optional)
+    void (*init)(void);
+    item *(*find)(const uint64_t b, const unsigned int power,
+        const char *key, const size_t nkey, const uint32_t hv);
+    //Returns false if an item with the same key is already there
+    bool (*insert)(const uint64_t b, const unsigned int power,
+        item *it, const uint32_t hv);
+    //found is set if the item was seen, even if someone else removed it first
+    bool (*delete)(const uint64_t b, const unsigned int power,
+        const char *key, const size_t nkey, const uint32_t hv, bool *found);
+    //Removes it itself (found by address), not whichever item has its key.
+    //  Returns false if it was not there
+    bool (*delete_item)(const uint64_t b, const unsigned int power,
+        item *it, const uint32_t hv);
+    //Replaces whichever item has new_it's key, inserts new_it if there is none
+    bool (*replace)(const uint64_t b, const unsigned int power,
+        item *old_it, item *new_it, const uint32_t hv);
+    //Replaces old_it itself with new_it. Returns false, without storing
+    //  new_it, if old_it is not there anymore (replaced or removed)
+    bool (*replace_if)(const uint64_t b, const unsigned int power,
+        item *old_it, item *new_it, const uint32_t hv);
+    //Ticks the CLOCK of the items of bucket b that hold memory of slab class
+    //  clsid (assoc_frees_class), removing those not used since the last
+    //  tick. Returns how many were removed
+    int (*evict)(const uint64_t b, const unsigned int clsid);
+    //Moves the items homed in buckets [first, last) of a table of old_power
+    //  whose bucket is different in a table of new_power (one more or one
+    //  less). Called while resizing, by workers and the maintenance thread,
+    //  for ranges no one else is migrating. Engines without it are resized
+    //  by just publishing the new hashpower
+    void (*migrate)(const uint64_t first, const uint64_t last,
+        const unsigned int old_power, const unsigned int new_power, reclamation *recl);
+    //Called after the table shrank, before buckets [first, last) are freed.
+    //  No operation uses them as buckets anymore (optional)
+    void (*release)(const uint64_t first, const uint64_t last);
+    //Batched lookups prefetch every bucket first, then call this once the
+    //  bucket is (likely) cached to prefetch the first item find would read
+    //  for hv. Must only read the bucket, it is a hint (optional)
+    void (*prefetch)(const uint64_t b, const unsigned int power, const uint32_t hv);
+};
+
+/* CLOCK: every item counts its recent uses in it->clock_ref, up to
+ * CLOCK_MAX. Fetching it bumps it, and a new version of a key starts from
+ * the count of the one it replaces. New keys start at 0, so keys that are
+ * never read again go first. The eviction hand ticks counts down as it
+ * passes and evicts the items it finds at 0, not their whole bucket. */
+#define CLOCK_MAX 3
+
+//Returns false if the count is at CLOCK_MAX already, nothing was written
+static inline bool assoc_clock_bump(item *it) {
+    uint8_t v = __atomic_load_n(&it->clock_ref, __ATOMIC_RELAXED);
+    if (v >= CLOCK_MAX)
+        return false;
+    __atomic_store_n(&it->clock_ref, v + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+//Returns false if it was not used since the hand last passed: it can go
+static inline bool assoc_clock_tick(item *it) {
+    uint8_t v = __atomic_load_n(&it->clock_ref, __ATOMIC_RELAXED);
+    if (v == 0)
+        return false;
+    __atomic_store_n(&it->clock_ref, v - 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+//Slab class of the chunks chunked items are made of, see assoc_chunk_class()
+extern unsigned int assoc_chunk_clsid;
+
+//Known once the slabs are set up, which is after the table
+static inline unsigned int assoc_chunk_class(void) {
+    unsigned int id = __atomic_load_n(&assoc_chunk_clsid, __ATOMIC_RELAXED);
+    if (id == 0) {
+        id = slabs_clsid(settings.slab_chunk_size_max);
+        __atomic_store_n(&assoc_chunk_clsid, id, __ATOMIC_RELAXED);
+    }
+    return id;
+}
+
+//Whether evicting it gives memory back to slab class clsid. Evicting for
+//  any other class would not help the allocation that is waiting
+static inline bool assoc_frees_class(const item *it, const unsigned int clsid) {
+    return ITEM_clsid(it) == clsid
+        || ((it->it_flags & ITEM_CHUNKED) && clsid == assoc_chunk_clsid);
+}
+
+//Engines call it for every item their evict removes (stats, admission filter)
+void assoc_evicted(item *it);
+
+/* SIEVE (-o evict_algo=sieve, assoc_sieve.c): items queue up per slab
+ * class in the order they were stored, and a hand evicts the first item
+ * not used since it last passed, instead of try_evict() ticking buckets */
+void sieve_init(void);
+void sieve_push(item *it);
+int sieve_evict(const unsigned int clsid);
+void sieve_sweep(void);
+
+extern const assoc_engine tagged_engine;
+extern const assoc_engine solist_engine;
+
+//Accounts for an item an engine removed on its own: evicted to make room
+//  outside of its evict, or a stale duplicate
+void assoc_item_dropped(item *it, const bool evicted);
+
+#endif
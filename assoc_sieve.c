@@ -0,0 +1,173 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * SIEVE eviction
+ *
+ * Every slab class has a FIFO queue of the items stored in it, oldest
+ * first, linked through ITEM_sieve_next() (chunked items queue up in the
+ * class of their chunks). Storing an item appends it without locks: it
+ * swaps itself in as the newest item, then links the previous newest to
+ * it. Reads only set the item's visited bit (clock_ref, as CLOCK counts
+ * do) and never move it.
+ * The hand of a class walks from the oldest item to the newest and evicts
+ * the first one that was not visited since it last passed, clearing the
+ * visited ones. Hands are serialized per class; only a hand takes items
+ * out of its queue, so it needs no more than the item before the one it
+ * looks at.
+ *
+ * An item that leaves the table some other way (deleted, replaced, ...)
+ * stays queued, and reclaiming it only flags it dead: the hand frees it
+ * once it unlinks it, as does sieve_sweep() when dead items pile up. The
+ * newest item is never unlinked, another thread may be linking to it.
+ */
+
+#include "memcached.h"
+#include "assoc_engine.h"
+
+#define SIEVE_QUEUED 1
+#define SIEVE_DEAD   2 //Reclaimed while queued, whoever unlinks it frees it
+
+//Dead items a queue holds before sieve_sweep() frees them, at least
+#define SIEVE_SWEEP_MIN 64
+
+typedef struct {
+    item *head;            //Newest item
+    uint64_t queued;       //Items in the queue, dead ones included
+    uint64_t dead;
+    pthread_mutex_t lock;  //Of the hand
+    item *hand;            //Item before the one the hand looks at next
+    item *stub;            //Before the oldest item, never leaves
+} __attribute__((aligned(ASSOC_CACHE_LINE))) sieve_queue;
+
+bool assoc_sieve = false;
+static sieve_queue queues[MAX_NUMBER_OF_SLAB_CLASSES];
+
+static inline sieve_queue *queue_of(const item *it) {
+    return &queues[(it->it_flags & ITEM_CHUNKED) ? assoc_chunk_class() : ITEM_clsid(it)];
+}
+
+void sieve_init(void) {
+    for (int i = 0; i < MAX_NUMBER_OF_SLAB_CLASSES; i++) {
+        sieve_queue *q = &queues[i];
+        q->stub = calloc(1, sizeof(item) + sizeof(uint64_t));
+        if (!q->stub) {
+            fprintf(stderr, "Failed to allocate the SIEVE queues\n");
+            exit(EXIT_FAILURE);
+        }
+        q->stub->it_flags = ITEM_SIEVE;
+        q->head = q->hand = q->stub;
+        pthread_mutex_init(&q->lock, NULL);
+    }
+    assoc_sieve = true;
+}
+
+//Called once it is in the table
+void sieve_push(item *it) {
+    sieve_queue *q = queue_of(it);
+
+    *ITEM_sieve_next(it) = NULL;
+    __atomic_store_n(&it->sieve_state, SIEVE_QUEUED, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&q->queued, 1, __ATOMIC_RELAXED);
+
+    //Until the link is stored the hand takes prev for the newest item
+    item *prev = __atomic_exchange_n(&q->head, it, __ATOMIC_ACQ_REL);
+    __atomic_store_n(ITEM_sieve_next(prev), it, __ATOMIC_RELEASE);
+}
+
+/* Called by reclaim_item(): returns true if it is still queued, the hand
+ * frees it then. Its memory cannot go back to the slabs before */
+bool assoc_sieve_release(item *it) {
+    if (!assoc_sieve)
+        return false;
+
+    uint8_t s = __atomic_load_n(&it->sieve_state, __ATOMIC_ACQUIRE);
+    do {
+        if (!(s & SIEVE_QUEUED))
+            return false;
+    } while (!__atomic_compare_exchange_n(&it->sieve_state, &s, s | SIEVE_DEAD,
+        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    __atomic_fetch_add(&queue_of(it)->dead, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+//Takes cur, the item after prev, out of the queue, and frees it if it was
+//  reclaimed already. Returns false if it is the newest one
+static bool sieve_unlink(sieve_queue *q, item *prev, item *cur) {
+    item *next = __atomic_load_n(ITEM_sieve_next(cur), __ATOMIC_ACQUIRE);
+    if (next == NULL)
+        return false;
+
+    __atomic_store_n(ITEM_sieve_next(prev), next, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&q->queued, 1, __ATOMIC_RELAXED);
+    if (__atomic_exchange_n(&cur->sieve_state, 0, __ATOMIC_ACQ_REL) & SIEVE_DEAD) {
+        __atomic_fetch_sub(&q->dead, 1, __ATOMIC_RELAXED);
+        item_free(cur);
+    }
+    return true;
+}
+
+/* Moves the hand of class clsid until it evicted an item, at most twice
+ * around the queue: once to clear the visited bits. Dead items it passes
+ * are freed on the way. Returns how many items were evicted */
+int sieve_evict(const unsigned int clsid) {
+    sieve_queue *q = &queues[clsid];
+    int removed = 0;
+
+    pthread_mutex_lock(&q->lock);
+    uint64_t steps = 2 * __atomic_load_n(&q->queued, __ATOMIC_RELAXED) + 2;
+    item *prev = q->hand;
+    while (removed == 0 && steps-- > 0) {
+        item *cur = __atomic_load_n(ITEM_sieve_next(prev), __ATOMIC_ACQUIRE);
+        if (cur == NULL) {
+            //Past the newest, back to the oldest
+            prev = q->stub;
+            continue;
+        }
+
+        if (!(__atomic_load_n(&cur->sieve_state, __ATOMIC_ACQUIRE) & SIEVE_DEAD)) {
+            if (__atomic_load_n(&cur->clock_ref, __ATOMIC_RELAXED) != 0) {
+                __atomic_store_n(&cur->clock_ref, 0, __ATOMIC_RELAXED);
+                prev = cur;
+                continue;
+            }
+
+            //Someone else may have removed it already, it goes all the same
+            if (assoc_delete_item(cur, cur->hv)) {
+                assoc_evicted(cur);
+                removed++;
+            }
+        }
+
+        if (!sieve_unlink(q, prev, cur))
+            prev = cur;
+    }
+    q->hand = prev;
+    pthread_mutex_unlock(&q->lock);
+
+    return removed;
+}
+
+//Frees the dead items of the queues they are a quarter of. Called by the
+//  evictor, so that they do not hold on to memory until the class evicts
+void sieve_sweep(void) {
+    if (!assoc_sieve)
+        return;
+
+    for (int i = 0; i < MAX_NUMBER_OF_SLAB_CLASSES; i++) {
+        sieve_queue *q = &queues[i];
+        uint64_t dead = __atomic_load_n(&q->dead, __ATOMIC_RELAXED);
+        if (dead < SIEVE_SWEEP_MIN || dead * 4 < __atomic_load_n(&q->queued, __ATOMIC_RELAXED))
+            continue;
+
+        pthread_mutex_lock(&q->lock);
+        item *prev = q->stub, *cur;
+        while ((cur = __atomic_load_n(ITEM_sieve_next(prev), __ATOMIC_ACQUIRE)) != NULL) {
+            //The hand's item stays, it continues from there
+            if (cur == q->hand
+                || !(__atomic_load_n(&cur->sieve_state, __ATOMIC_ACQUIRE) & SIEVE_DEAD)
+                || !sieve_unlink(q, prev, cur))
+                prev = cur;
+        }
+        pthread_mutex_unlock(&q->lock);
+    }
+}
@@ -0,0 +1,462 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Split-ordered list hash table engine
+ *
+ * (Shalev and Shavit, "Split-Ordered Lists: Lock-Free Extensible Hash
+ * Tables"). Every item lives in a single lock-free list, sorted by the bit
+ * reversal of its hash value (its split order key). Buckets are dummy nodes
+ * in that same list, each one a shortcut to where the items of the bucket
+ * start. Items of bucket b are exactly those between the dummy of b and the
+ * next dummy, and splitting b when the table doubles only requires linking
+ * the dummy of its new sibling in the middle of them. Expansion therefore
+ * never moves items: the new segment is published, hashpower is bumped and
+ * the new dummies are linked lazily, by the first operation that uses them.
+ *
+ * Dummies are stored inline in the bucket segments. A dummy that is not
+ * linked yet (zero filled) is skipped by starting at its parent instead,
+ * the parent's dummy is also before the bucket's items, just further away.
+ *
+ * Items keep their hash value and split order key in the item header (in
+ * the space of prev, which only the slab freelist uses). The list uses the
+ * same deletion marks as nblist.c and removed items are retired through EBR.
+ */
+
+#include "memcached.h"
+#include "assoc_engine.h"
+#include "nblist.h"
+#include <stddef.h>
+
+/* Compare and Swap macro */
+#define CAS(p, e, d) __atomic_compare_exchange_n(p, e, d, \
+    0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+
+//Dummy states
+#define SO_UNLINKED 0
+#define SO_LINKING  1
+#define SO_LINKED   2
+
+//Laid out like the start of an item, so it can be a node of the list
+typedef struct {
+    item *next;
+    uint32_t state;     //Where items keep their hash value
+    uint32_t so_key;
+} so_bucket;
+
+_Static_assert(offsetof(so_bucket, next) == offsetof(item, next),
+    "dummy nodes must be laid out like items");
+_Static_assert(offsetof(so_bucket, so_key) == offsetof(item, so_key),
+    "dummy nodes must be laid out like items");
+
+static inline so_bucket *get_bucket(const uint64_t b) {
+    unsigned int seg = assoc_segment_of(b);
+    return (so_bucket*) assoc_segments[seg] + assoc_segment_offset(b, seg);
+}
+
+static inline uint32_t reverse32(uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    return __builtin_bswap32(x);
+}
+
+//Items have odd keys, dummies even ones, so a dummy always comes before
+//  the items of its bucket (which share the dummy's high bits)
+static inline uint32_t so_regular_key(const uint32_t hv) {
+    return reverse32(hv) | 1;
+}
+
+static inline uint32_t so_dummy_key(const uint64_t b) {
+    return reverse32((uint32_t) b);
+}
+
+//Bucket that was split to create b, i.e., b without its highest bit
+static inline uint64_t parent_of(const uint64_t b) {
+    return b & ~((uint64_t) 1 << (63 - __builtin_clzll(b)));
+}
+
+//Order of the list: split order key, then the key itself for items whose
+//  hash values are the same. key is NULL when looking for a dummy
+static inline int so_cmp(const item *t, const uint32_t so_key,
+    const char *key, const size_t nkey) {
+
+    if(t->so_key != so_key)
+        return t->so_key < so_key ? -1 : 1;
+    if(key == NULL)
+        return 0;
+    return KEY_cmp(ITEM_key(t), key, t->nkey, nkey);
+}
+
+/* Harris search (as in nblist.c) starting from a dummy that is linked.
+ * right_item is the first unmarked node not before (so_key, key), or after
+ * the nodes equal to it if after_equal. Marked nodes in between are
+ * unlinked, and retired if they are items. */
+static item *so_search(item *start, const uint32_t so_key, const char *key,
+    const size_t nkey, const bool after_equal, item **left_item) {
+
+	item *left_item_next = NULL, *right_item;
+
+search_again:
+	do {
+        item *t = start;
+        item *t_next = start->next;
+        int marked_counter = 0;
+        int cmp;
+
+		/* 1: Find left_item and right_item */
+        do {
+            if (!is_marked_reference(t_next)) {
+                (* left_item) = t;
+                left_item_next = t_next;
+                marked_counter = 0;
+            } else {
+                marked_counter++;
+            }
+
+            t = (item *) get_unmarked_reference(t_next);
+            if (t == NULL)
+				break;
+            t_next = t->next;
+        } while (is_marked_reference(t_next) ||
+            (cmp = so_cmp(t, so_key, key, nkey)) < 0 ||
+            (after_equal && cmp == 0)); /*B1*/
+
+        right_item = t;
+		/* 2: Check items are adjacent */
+        if (left_item_next == right_item) {
+            if ((right_item != NULL) && is_marked_reference(right_item->next))
+                goto search_again; /*G1*/
+			else
+				return right_item; /*R1*/
+		}
+
+ 		/* 3: Remove one or more marked items */
+        if (CAS(&((*left_item)->next), &left_item_next, right_item)) { /*C1*/
+            //Add one or more marked items to be reclaimed
+            item *e = (item*) get_unmarked_reference(left_item_next);
+            while(e != NULL && marked_counter > 0) {
+                //Dummies are freed with their segment
+                if(e->so_key & 1)
+                    ebr_add_retired_item(e, CUSTOM_TYPE);
+                e = (item*) get_unmarked_reference(e->next);
+                marked_counter--;
+            }
+
+            if ((right_item != NULL) && is_marked_reference(right_item->next))
+				goto search_again; /*G2*/
+            else
+		      	return right_item; /*R2*/
+		}
+
+    } while (true); /*B2*/
+}
+
+static item *bucket_start(uint64_t b);
+
+//Links the dummy of bucket b, which the caller claimed (SO_LINKING)
+static void link_bucket(const uint64_t b, so_bucket *bkt) {
+    item *start = bucket_start(parent_of(b));
+    item *left_item, *right_item;
+
+    bkt->so_key = so_dummy_key(b);
+    do {
+        right_item = so_search(start, bkt->so_key, NULL, 0, false, &left_item);
+        bkt->next = right_item;
+    } while(!CAS(&left_item->next, &right_item, (item*) bkt));
+
+    __atomic_store_n(&bkt->state, SO_LINKED, __ATOMIC_RELEASE);
+}
+
+//Node searches for items of bucket b start from
+static item *bucket_start(uint64_t b) {
+    so_bucket *bkt = get_bucket(b);
+
+    //Bucket 0 (zero filled) is the head of the list
+    while(b != 0 && __atomic_load_n(&bkt->state, __ATOMIC_ACQUIRE) != SO_LINKED) {
+        uint32_t expected = SO_UNLINKED;
+        if(__atomic_compare_exchange_n(&bkt->state, &expected, SO_LINKING,
+            false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            link_bucket(b, bkt);
+            break;
+        }
+
+        //Being linked by someone else, do not wait for it
+        b = parent_of(b);
+        bkt = get_bucket(b);
+    }
+
+    return (item*) bkt;
+}
+
+//Marks right_item (found after left_item) as deleted and unlinks it
+static bool so_del(item *start, item *left_item, item *right_item) {
+    item *right_item_next, *e = right_item;
+
+    do {
+        right_item_next = right_item->next;
+        if(is_marked_reference(right_item_next))
+            return false; //Someone else deleted it
+    } while(!CAS(&(right_item->next), &right_item_next,
+        (item*) get_marked_reference(right_item_next))); /*C3*/
+
+    if(CAS(&(left_item->next), &right_item, right_item_next)) { /*C4*/
+        ebr_add_retired_item(e, CUSTOM_TYPE);
+    } else {
+        //Let a search unlink (and retire) it
+        so_search(start, e->so_key, ITEM_key(e), e->nkey, false, &left_item);
+    }
+
+    return true;
+}
+
+static item *solist_find(const uint64_t b, const unsigned int power,
+    const char *key, const size_t nkey, const uint32_t hv) {
+    item *left_item, *right_item;
+    uint32_t so_key = so_regular_key(hv);
+
+    right_item = so_search(bucket_start(b), so_key, key, nkey, false, &left_item);
+    if(right_item == NULL || so_cmp(right_item, so_key, key, nkey) != 0)
+        return NULL;
+    return right_item;
+}
+
+//Only the start of the bucket's part of the list, the key may be further
+static void solist_prefetch(const uint64_t b, const unsigned int power, const uint32_t hv) {
+    so_bucket *bkt = get_bucket(b);
+
+    //Bucket 0 is the head of the list, it is never linked
+    if(b == 0 || __atomic_load_n(&bkt->state, __ATOMIC_ACQUIRE) == SO_LINKED) {
+        item *it = (item*) get_unmarked_reference(bkt->next);
+        if(it != NULL)
+            __builtin_prefetch(it, 0, 3);
+    }
+}
+
+static bool solist_insert(const uint64_t b, const unsigned int power,
+    item *it, const uint32_t hv) {
+    item *start = bucket_start(b);
+    item *left_item, *right_item;
+
+    it->hv = hv;
+    it->so_key = so_regular_key(hv);
+
+    do {
+        right_item = so_search(start, it->so_key, ITEM_key(it), it->nkey, false, &left_item);
+        if(right_item != NULL && so_cmp(right_item, it->so_key, ITEM_key(it), it->nkey) == 0)
+            return false; /*T1*/
+
+        it->next = right_item;
+    } while(!CAS(&(left_item->next), &right_item, it)); /*C2*/
+
+    return true;
+}
+
+static bool solist_delete(const uint64_t b, const unsigned int power,
+    const char *key, const size_t nkey, const uint32_t hv, bool *found) {
+    item *start = bucket_start(b);
+    item *left_item, *right_item;
+    uint32_t so_key = so_regular_key(hv);
+
+    do {
+        right_item = so_search(start, so_key, key, nkey, false, &left_item);
+        if(right_item == NULL || so_cmp(right_item, so_key, key, nkey) != 0)
+            return false;
+        *found = true;
+    } while(!so_del(start, left_item, right_item));
+
+    return true;
+}
+
+static bool solist_delete_item(const uint64_t b, const unsigned int power,
+    item *it, const uint32_t hv) {
+    item *start = bucket_start(b);
+    item *left_item, *right_item;
+    uint32_t so_key = so_regular_key(hv);
+
+    do {
+        right_item = so_search(start, so_key, ITEM_key(it), it->nkey, false, &left_item);
+        //Versions of the key are next to each other, older ones first
+        while(right_item != NULL && right_item != it &&
+            so_cmp(right_item, so_key, ITEM_key(it), it->nkey) == 0) {
+            left_item = right_item;
+            right_item = (item*) get_unmarked_reference(right_item->next);
+        }
+        if(right_item != it)
+            return false;
+    } while(!so_del(start, left_item, right_item));
+
+    return true;
+}
+
+//Inserts new_it after the nodes with its key, then deletes those
+//  (as the posterior insertion replacement of nblist.c does)
+static bool solist_replace(const uint64_t b, const unsigned int power,
+    item *old_it, item *new_it, const uint32_t hv) {
+    item *start = bucket_start(b);
+    item *left_item, *right_item;
+    const char *key = ITEM_key(new_it);
+    const size_t nkey = new_it->nkey;
+
+    new_it->hv = hv;
+    new_it->so_key = so_regular_key(hv);
+
+    do {
+        right_item = so_search(start, new_it->so_key, key, nkey, true, &left_item);
+        new_it->next = right_item;
+    } while(!CAS(&(left_item->next), &right_item, new_it));
+
+    //Older versions are the ones before it
+    while((right_item = so_search(start, new_it->so_key, key, nkey, false, &left_item)) != new_it) {
+        //If new_it is not marked, it was found after right_item, which is then older.
+        //  Otherwise new_it was replaced or deleted meanwhile, by someone that
+        //  takes care of what is left
+        if(right_item == NULL || is_marked_reference(new_it->next))
+            break;
+        so_del(start, left_item, right_item);
+    }
+
+    return true;
+}
+
+//Marks old_it as deleted and links new_it in its place with a single CAS,
+//  as replace_if() does in nblist.c
+static bool solist_replace_if(const uint64_t b, const unsigned int power,
+    item *old_it, item *new_it, const uint32_t hv) {
+    item *left_item, *old_it_next;
+
+    new_it->hv = hv;
+    new_it->so_key = so_regular_key(hv);
+
+    do {
+        old_it_next = old_it->next;
+        if(is_marked_reference(old_it_next))
+            return false;
+        new_it->next = old_it_next;
+    } while(!CAS(&(old_it->next), &old_it_next, (item*) get_marked_reference(new_it)));
+
+    //Unlinks (and retires) old_it
+    so_search(bucket_start(b), new_it->so_key, ITEM_key(new_it), new_it->nkey, false, &left_item);
+    return true;
+}
+
+//Unlinks (and retires) every run of marked items from start to the next
+//  dummy, as cleanup() does in nblist.c: a search only unlinks the run
+//  right before the node it looks for
+static void so_cleanup(item *start) {
+    item *left_item, *left_item_next, *t, *t_next;
+    int marked_counter;
+
+cleanup_again:
+    left_item = start;
+    left_item_next = start->next;
+    if(is_marked_reference(left_item_next))
+        return; //Released, searches from its parent unlink what follows
+    marked_counter = 0;
+    t = left_item_next;
+
+    while(true) {
+        t_next = (t != NULL) ? t->next : NULL;
+        if(t != NULL && is_marked_reference(t_next)) {
+            marked_counter++;
+            t = (item*) get_unmarked_reference(t_next);
+            continue;
+        }
+
+        //t ends a run of marked items, if there is one before it
+        if(marked_counter > 0) {
+            if(!CAS(&(left_item->next), &left_item_next, t))
+                goto cleanup_again;
+
+            item *e = left_item_next;
+            for(; marked_counter > 0; marked_counter--) {
+                //Dummies are freed with their segment
+                if(e->so_key & 1)
+                    ebr_add_retired_item(e, CUSTOM_TYPE);
+                e = (item*) get_unmarked_reference(e->next);
+            }
+        }
+
+        if(t == NULL || !(t->so_key & 1))
+            return;
+        left_item = t;
+        left_item_next = t_next;
+        t = t_next;
+    }
+}
+
+//Removes the cold items of bucket b, i.e., until the next dummy, that hold
+//  memory of class clsid
+static int solist_evict(const uint64_t b, const unsigned int clsid) {
+    so_bucket *bkt = get_bucket(b);
+    if(b != 0 && __atomic_load_n(&bkt->state, __ATOMIC_ACQUIRE) != SO_LINKED)
+        return 0; //Its items are still reached through the parent
+
+    item *start = (item*) bkt, *e, *e_next;
+    int marked = 0;
+
+    for(e = (item*) get_unmarked_reference(start->next);
+        e != NULL && (e->so_key & 1);
+        e = (item*) get_unmarked_reference(e->next)) {
+
+        if(!assoc_frees_class(e, clsid) || assoc_clock_tick(e))
+            continue;
+
+        do {
+            e_next = e->next;
+            if(is_marked_reference(e_next))
+                break;
+            if(CAS(&(e->next), &e_next, (item*) get_marked_reference(e_next))) {
+                assoc_evicted(e);
+                marked++;
+                break;
+            }
+        } while(true);
+    }
+
+    //Unlink (and retire) what was marked, it is not contiguous
+    if(marked > 0)
+        so_cleanup(start);
+
+    return marked;
+}
+
+//Unlinks the dummies of buckets that are past the table after it shrank,
+//  their items are reached through the parents' dummies again
+static void solist_release(const uint64_t first, const uint64_t last) {
+    item *left_item;
+
+    for(uint64_t b = first; b < last; b++) {
+        so_bucket *bkt = get_bucket(b);
+        //No one is linking it, it was used as a bucket two epochs ago at most
+        if(__atomic_load_n(&bkt->state, __ATOMIC_ACQUIRE) != SO_LINKED)
+            continue;
+
+        //Marked like a deleted item, so that searches unlink it
+        item *d = (item*) bkt, *d_next;
+        do {
+            d_next = d->next;
+        } while(!CAS(&(d->next), &d_next, (item*) get_marked_reference(d_next)));
+
+        so_search(bucket_start(parent_of(b)), bkt->so_key, NULL, 0, false, &left_item);
+    }
+}
+
+const assoc_engine solist_engine = {
+    .name = "solist",
+    .bucket_size = sizeof(so_bucket),
+    //Same as nblist, items of a bucket form a chain as well
+    .max_load_pct = 150,
+    //Dummies of buckets past 2^31 would have odd keys
+    .max_hashpower = 31,
+    .init = NULL,
+    .find = solist_find,
+    .insert = solist_insert,
+    .delete = solist_delete,
+    .delete_item = solist_delete_item,
+    .replace = solist_replace,
+    .replace_if = solist_replace_if,
+    .evict = solist_evict,
+    //Items never move
+    .migrate = NULL,
+    .release = solist_release,
+    .prefetch = solist_prefetch,
+};
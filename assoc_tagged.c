@@ -0,0 +1,503 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Tagged bucket hash table engine
+ *
+ * Every bucket fills exactly one cache line: a one byte tag (a fingerprint
+ * of the item's hash value) for each of its 7 slots, a meta byte and the 7
+ * item pointers. Lookups compare tags first and only dereference the items
+ * whose tag matches, so most lookups of missing keys never leave the
+ * bucket's cache line.
+ *
+ * Lookups, deletes and replacements are lock-free (CAS on slots).
+ * Insertions of new keys are serialized per home bucket by a lock bit in
+ * the meta byte, otherwise two threads inserting the same key could both
+ * find it missing and insert it twice. Items that do not fit in their home
+ * bucket go to one of the following TAGGED_PROBE - 1 buckets, and the home
+ * bucket is flagged so that lookups know to look there too. If those are
+ * full as well an item of the home bucket is displaced (evicted).
+ *
+ * Removed items are retired through EBR, like the nblist engine does.
+ *
+ * Tags and the meta byte form the first 8 bytes of a bucket, they are
+ * compared against a probe's tag all at once (SSE2, NEON or SWAR, chosen
+ * at startup) giving a bitmask of the slots worth looking at.
+ */
+
+#include "memcached.h"
+#include "assoc_engine.h"
+#include "nblist.h"
+#include <sched.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define TAG_MATCH_SSE2
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TAG_MATCH_NEON
+#endif
+
+#define TAGGED_SLOTS 7
+
+//Meta bits
+#define TAGGED_LOCKED   1 //A new key is being inserted in this (home) bucket
+#define TAGGED_OVERFLOW 2 //Items of this home bucket were placed in the
+                          //  following buckets. Never cleared, stale bits
+                          //  only cost extra probes
+
+//Number of buckets, starting at the home bucket, an item can be placed in
+#define TAGGED_PROBE 4
+
+typedef struct {
+    union {
+        struct {
+            uint8_t tags[TAGGED_SLOTS];
+            uint8_t meta;
+        };
+        uint64_t header; //Tags and meta, as loaded by the match kernels
+    };
+    item *slots[TAGGED_SLOTS];
+} tagged_bucket;
+
+_Static_assert(sizeof(tagged_bucket) == ASSOC_CACHE_LINE,
+    "tagged buckets must fill exactly one cache line");
+
+//Slot of the home bucket to displace next, when everything is full
+static __thread unsigned int victim_hand = 0;
+
+//Returns a mask with bit i set if tags[i] is tag
+typedef uint32_t (*tag_match_func)(const tagged_bucket *bkt, const uint8_t tag);
+static tag_match_func match_tags;
+
+//Mask of the bits that stand for slots, the meta byte is compared as well
+#define SLOTS_MASK ((1u << TAGGED_SLOTS) - 1)
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+//SIMD within a register: sets the high bit of every byte equal to tag
+//  (exactly, no false positives) and gathers those bits in the low byte
+static uint32_t match_tags_swar(const tagged_bucket *bkt, const uint8_t tag) {
+    const uint64_t lows = 0x7F7F7F7F7F7F7F7FULL;
+    uint64_t x = __atomic_load_n(&bkt->header, __ATOMIC_RELAXED) ^ (0x0101010101010101ULL * tag);
+    uint64_t zeros = ~(((x & lows) + lows) | x | lows);
+    return (((zeros >> 7) * 0x0102040810204080ULL) >> 56) & SLOTS_MASK;
+}
+#else
+//One byte at a time, the SWAR gather above assumes tags[0] is the low byte
+static uint32_t match_tags_scalar(const tagged_bucket *bkt, const uint8_t tag) {
+    uint32_t mask = 0;
+    for(int i = 0; i < TAGGED_SLOTS; i++) {
+        if(__atomic_load_n(&bkt->tags[i], __ATOMIC_RELAXED) == tag)
+            mask |= 1u << i;
+    }
+    return mask;
+}
+#endif
+
+#ifdef TAG_MATCH_SSE2
+static uint32_t match_tags_sse2(const tagged_bucket *bkt, const uint8_t tag) {
+    __m128i tags = _mm_loadl_epi64((const __m128i*) &bkt->header);
+    __m128i eq = _mm_cmpeq_epi8(tags, _mm_set1_epi8((char) tag));
+    return _mm_movemask_epi8(eq) & SLOTS_MASK;
+}
+#endif
+
+#ifdef TAG_MATCH_NEON
+static uint32_t match_tags_neon(const tagged_bucket *bkt, const uint8_t tag) {
+    static const uint8_t bits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x8_t eq = vceq_u8(vld1_u8(bkt->tags), vdup_n_u8(tag));
+    return vaddv_u8(vand_u8(eq, vld1_u8(bits))) & SLOTS_MASK;
+}
+#endif
+
+static void tagged_init(void) {
+    const char *kernel;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    match_tags = match_tags_swar;
+    kernel = "swar";
+#else
+    match_tags = match_tags_scalar;
+    kernel = "scalar";
+#endif
+
+#ifdef TAG_MATCH_SSE2
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2")) {
+        match_tags = match_tags_sse2;
+        kernel = "sse2";
+    }
+#endif
+#ifdef TAG_MATCH_NEON
+    //Always there on aarch64
+    match_tags = match_tags_neon;
+    kernel = "neon";
+#endif
+
+    if(settings.verbose > 0)
+        fprintf(stderr, "Tagged hash table matches tags with %s\n", kernel);
+}
+
+static inline tagged_bucket *get_bucket(const uint64_t b) {
+    unsigned int seg = assoc_segment_of(b);
+    return (tagged_bucket*) assoc_segments[seg] + assoc_segment_offset(b, seg);
+}
+
+//The low bits of hv choose the bucket, so the tag must depend on all of them
+//  Tag 0 is never used, it is what empty (zero filled) buckets hold
+static inline uint8_t get_tag(const uint32_t hv) {
+    uint8_t tag = (hv * 0x9E3779B1u) >> 24;
+    return tag == 0 ? 1 : tag;
+}
+
+//Buckets an item homed in b can be in are [b, probe_end), probing does not
+//  wrap around so items stay reachable after the table is expanded
+static inline uint64_t probe_end(const uint64_t b, const unsigned int power) {
+    uint64_t end = b + TAGGED_PROBE;
+    return end < hashsize(power) ? end : hashsize(power);
+}
+
+//Returns the slot holding key in bkt, and the item in it, or NULL
+static inline item **bucket_find(tagged_bucket *bkt, const uint8_t tag,
+    const char *key, const size_t nkey, item **found) {
+
+    for(uint32_t mask = match_tags(bkt, tag); mask != 0; mask &= mask - 1) {
+        int i = __builtin_ctz(mask);
+        item *it = __atomic_load_n(&bkt->slots[i], __ATOMIC_ACQUIRE);
+        if(it != NULL && KEY_cmp(ITEM_key(it), key, it->nkey, nkey) == 0) {
+            *found = it;
+            return &bkt->slots[i];
+        }
+    }
+
+    return NULL;
+}
+
+//Returns the slot holding key, looking past the home bucket only if needed
+static item **find_slot(uint64_t b, const unsigned int power, const uint8_t tag,
+    const char *key, const size_t nkey, item **found) {
+
+    tagged_bucket *home = get_bucket(b);
+    item **slot = bucket_find(home, tag, key, nkey, found);
+    if(slot != NULL || !(__atomic_load_n(&home->meta, __ATOMIC_ACQUIRE) & TAGGED_OVERFLOW))
+        return slot;
+
+    uint64_t end = probe_end(b, power);
+    for(b++; b < end; b++) {
+        slot = bucket_find(get_bucket(b), tag, key, nkey, found);
+        if(slot != NULL)
+            return slot;
+    }
+
+    return NULL;
+}
+
+//Returns the slot holding it, found by address instead of by key
+static item **find_item_slot(const uint64_t b, const unsigned int power,
+    const uint8_t tag, const item *it) {
+
+    uint64_t end = probe_end(b, power);
+    for(uint64_t i = b; i < end; i++) {
+        tagged_bucket *bkt = get_bucket(i);
+
+        for(uint32_t mask = match_tags(bkt, tag); mask != 0; mask &= mask - 1) {
+            int s = __builtin_ctz(mask);
+            if(__atomic_load_n(&bkt->slots[s], __ATOMIC_ACQUIRE) == it)
+                return &bkt->slots[s];
+        }
+
+        if(i == b && !(__atomic_load_n(&bkt->meta, __ATOMIC_ACQUIRE) & TAGGED_OVERFLOW))
+            break;
+    }
+
+    return NULL;
+}
+
+static inline void bucket_lock(tagged_bucket *bkt) {
+    while(__atomic_fetch_or(&bkt->meta, TAGGED_LOCKED, __ATOMIC_ACQUIRE) & TAGGED_LOCKED) {
+        while(__atomic_load_n(&bkt->meta, __ATOMIC_RELAXED) & TAGGED_LOCKED)
+            sched_yield();
+    }
+}
+
+static inline void bucket_unlock(tagged_bucket *bkt) {
+    __atomic_fetch_and(&bkt->meta, (uint8_t) ~TAGGED_LOCKED, __ATOMIC_RELEASE);
+}
+
+//Puts it in a free slot of bkt
+static bool bucket_place(tagged_bucket *bkt, const uint8_t tag, item *it) {
+    for(int i = 0; i < TAGGED_SLOTS; i++) {
+        item *expected = NULL;
+        if(__atomic_load_n(&bkt->slots[i], __ATOMIC_RELAXED) == NULL &&
+            __atomic_compare_exchange_n(&bkt->slots[i], &expected, it,
+                false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+
+            //The tag is written after the slot is ours, as buckets other than
+            //  the home bucket can be filled concurrently. Until then the item
+            //  is not found, i.e., its insertion has not finished
+            __atomic_store_n(&bkt->tags[i], tag, __ATOMIC_RELEASE);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//Places a new item, the home bucket b must be locked
+static void place(const uint64_t b, const unsigned int power, const uint8_t tag,
+    item *it, reclamation *r) {
+
+    tagged_bucket *home = get_bucket(b);
+    if(bucket_place(home, tag, it))
+        return;
+
+    uint64_t end = probe_end(b, power);
+    if(b + 1 < end) {
+        //Flag before placing, so that lookups of it look past home
+        __atomic_fetch_or(&home->meta, TAGGED_OVERFLOW, __ATOMIC_RELEASE);
+
+        for(uint64_t n = b + 1; n < end; n++) {
+            if(bucket_place(get_bucket(n), tag, it))
+                return;
+        }
+    }
+
+    //Every bucket in reach is full, displace an item of the home bucket
+    //  and do not wait for the next periodic check to grow the table
+    assoc_check_expand();
+
+    for(int tries = 0; ; tries++) {
+        unsigned int i = victim_hand++ % TAGGED_SLOTS;
+        item *victim = __atomic_load_n(&home->slots[i], __ATOMIC_ACQUIRE);
+
+        if(victim == NULL) {
+            //Removed meanwhile
+            if(bucket_place(home, tag, it))
+                return;
+            continue;
+        }
+
+        //The first cold one, after as many turns as a count can take
+        if(tries < TAGGED_SLOTS * (CLOCK_MAX + 1) && assoc_clock_tick(victim))
+            continue;
+
+        if(__atomic_compare_exchange_n(&home->slots[i], &victim, it,
+            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&home->tags[i], tag, __ATOMIC_RELEASE);
+            assoc_item_dropped(victim, true);
+            add_retired_item(r, victim, CUSTOM_TYPE);
+            return;
+        }
+    }
+}
+
+static item *tagged_find(const uint64_t b, const unsigned int power,
+    const char *key, const size_t nkey, const uint32_t hv) {
+    item *it;
+
+    if(find_slot(b, power, get_tag(hv), key, nkey, &it) == NULL)
+        return NULL;
+    return it;
+}
+
+static void tagged_prefetch(const uint64_t b, const unsigned int power, const uint32_t hv) {
+    tagged_bucket *bkt = get_bucket(b);
+    uint32_t mask = match_tags(bkt, get_tag(hv));
+
+    //Tags rarely match by chance, the first match is almost always the key
+    if(mask != 0) {
+        item *it = __atomic_load_n(&bkt->slots[__builtin_ctz(mask)], __ATOMIC_RELAXED);
+        if(it != NULL)
+            __builtin_prefetch(ITEM_key(it), 0, 3);
+    }
+}
+
+static bool tagged_insert(const uint64_t b, const unsigned int power,
+    item *it, const uint32_t hv) {
+    const uint8_t tag = get_tag(hv);
+    tagged_bucket *home = get_bucket(b);
+    item *found;
+    bool ret = false;
+
+    bucket_lock(home);
+
+    if(find_slot(b, power, tag, ITEM_key(it), it->nkey, &found) == NULL) {
+        place(b, power, tag, it, recl);
+        ret = true;
+    }
+
+    bucket_unlock(home);
+    return ret;
+}
+
+static bool tagged_delete(const uint64_t b, const unsigned int power,
+    const char *key, const size_t nkey, const uint32_t hv, bool *found) {
+    const uint8_t tag = get_tag(hv);
+    item **slot, *it;
+
+    while((slot = find_slot(b, power, tag, key, nkey, &it)) != NULL) {
+        *found = true;
+
+        if(__atomic_compare_exchange_n(slot, &it, NULL,
+            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            //The tag is left behind, the next insertion in this slot overwrites it
+            ebr_add_retired_item(it, CUSTOM_TYPE);
+            return true;
+        }
+        //Slot changed (item replaced or removed), look again
+    }
+
+    return false;
+}
+
+static bool tagged_delete_item(const uint64_t b, const unsigned int power,
+    item *it, const uint32_t hv) {
+    item **slot = find_item_slot(b, power, get_tag(hv), it);
+    item *expected = it;
+
+    //If the slot changed, it was replaced, removed or displaced meanwhile
+    if(slot == NULL || !__atomic_compare_exchange_n(slot, &expected, NULL,
+        false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return false;
+
+    ebr_add_retired_item(it, CUSTOM_TYPE);
+    return true;
+}
+
+static bool tagged_replace_if(const uint64_t b, const unsigned int power,
+    item *old_it, item *new_it, const uint32_t hv) {
+    item **slot = find_item_slot(b, power, get_tag(hv), old_it);
+    item *expected = old_it;
+
+    //Same tag, it is the same key
+    if(slot == NULL || !__atomic_compare_exchange_n(slot, &expected, new_it,
+        false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return false;
+
+    ebr_add_retired_item(old_it, CUSTOM_TYPE);
+    return true;
+}
+
+static bool tagged_replace(const uint64_t b, const unsigned int power,
+    item *old_it, item *new_it, const uint32_t hv) {
+    const uint8_t tag = get_tag(hv);
+    const char *key = ITEM_key(new_it);
+    const size_t nkey = new_it->nkey;
+    item **slot, *it;
+
+    while((slot = find_slot(b, power, tag, key, nkey, &it)) != NULL) {
+        if(__atomic_compare_exchange_n(slot, &it, new_it,
+            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            ebr_add_retired_item(it, CUSTOM_TYPE);
+            return true;
+        }
+    }
+
+    //Nothing to replace, insert it as a new key. Replacements of the key
+    //  may still run concurrently, so look for it again after locking
+    tagged_bucket *home = get_bucket(b);
+    bucket_lock(home);
+
+    while((slot = find_slot(b, power, tag, key, nkey, &it)) != NULL) {
+        if(__atomic_compare_exchange_n(slot, &it, new_it,
+            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            ebr_add_retired_item(it, CUSTOM_TYPE);
+            break;
+        }
+    }
+
+    if(slot == NULL)
+        place(b, power, tag, new_it, recl);
+
+    bucket_unlock(home);
+    return true;
+}
+
+static int tagged_evict(const uint64_t b, const unsigned int clsid) {
+    tagged_bucket *bkt = get_bucket(b);
+    int removed = 0;
+
+    for(int i = 0; i < TAGGED_SLOTS; i++) {
+        item *it = __atomic_load_n(&bkt->slots[i], __ATOMIC_ACQUIRE);
+        if(it != NULL && assoc_frees_class(it, clsid) && !assoc_clock_tick(it)
+            && __atomic_compare_exchange_n(&bkt->slots[i], &it, NULL,
+            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            assoc_evicted(it);
+            ebr_add_retired_item(it, CUSTOM_TYPE);
+            removed++;
+        }
+    }
+
+    return removed;
+}
+
+//Items homed in the range can also be in the TAGGED_PROBE - 1 buckets after it
+static void tagged_migrate(const uint64_t first, const uint64_t last,
+    const unsigned int old_power, const unsigned int new_power, reclamation *r) {
+    uint64_t end = probe_end(last - 1, old_power);
+    uint64_t new_size = hashsize(new_power);
+
+    for(uint64_t b = first; b < end; b++) {
+        tagged_bucket *bkt = get_bucket(b);
+
+        for(int i = 0; i < TAGGED_SLOTS; i++) {
+            item *it;
+retry:
+            it = __atomic_load_n(&bkt->slots[i], __ATOMIC_ACQUIRE);
+            if(it == NULL)
+                continue;
+
+            uint32_t hv = it->hv;
+            uint64_t old_home = hv & hashmask(old_power);
+            uint64_t new_home = hv & hashmask(new_power);
+
+            //Items whose home did not change are still reachable, as probing
+            //  does not wrap around, unless they are past the shrunk table
+            //  (only the first range reaches those). Spilled items of other
+            //  ranges are theirs
+            bool past_end = b >= new_size && old_home < new_size;
+            if(!past_end && (new_home == old_home || old_home < first || old_home >= last))
+                continue;
+
+            //Like in the nblist engine, the item is not visible until placed again
+            if(!__atomic_compare_exchange_n(&bkt->slots[i], &it, NULL,
+                false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+                goto retry; //Replaced or removed, the new content may have to move too
+
+            const uint8_t tag = get_tag(hv);
+            tagged_bucket *home = get_bucket(new_home);
+            item *found;
+
+            bucket_lock(home);
+
+            if(find_slot(new_home, new_power, tag, ITEM_key(it), it->nkey, &found) == NULL) {
+                place(new_home, new_power, tag, it, r);
+            } else {
+                //Inserted again while it was not visible, the newer one stays
+                assoc_item_dropped(it, false);
+                add_retired_item(r, it, CUSTOM_TYPE);
+            }
+
+            bucket_unlock(home);
+        }
+    }
+}
+
+const assoc_engine tagged_engine = {
+    .name = "tagged",
+    .bucket_size = sizeof(tagged_bucket),
+    //4 items per 7 slot bucket, leaves room for skewed buckets
+    .max_load_pct = 400,
+    .max_hashpower = HASHPOWER_MAX,
+    .init = tagged_init,
+    .find = tagged_find,
+    .insert = tagged_insert,
+    .delete = tagged_delete,
+    .delete_item = tagged_delete_item,
+    .replace = tagged_replace,
+    .replace_if = tagged_replace_if,
+    .evict = tagged_evict,
+    .migrate = tagged_migrate,
+    .release = NULL,
+    .prefetch = tagged_prefetch,
+};
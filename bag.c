@@ -1,70 +1,132 @@
 #include "bag.h"
 
-bag* create_bag(int bag_size) {
+//Adds n blocks to the pool
+static void pool_grow(bag_pool *p, int n) {
+    for(int i = 0; i < n; i++) {
+        bag_block *blk = malloc(sizeof(bag_block));
+        if(blk == NULL) {
+            fprintf(stderr, "Could not allocate bag block %d\n", p->num_blocks);
+            exit(EXIT_FAILURE);
+        }
+        blk->next = p->free_blocks;
+        p->free_blocks = blk;
+        p->num_blocks++;
+    }
+}
+
+//Pool with enough blocks for bag_size elements
+bag_pool* create_bag_pool(int bag_size) {
+    bag_pool *p = malloc(sizeof(bag_pool));
+    if(p == NULL) {
+        fprintf(stderr, "Could not allocate bag pool\n");
+        exit(EXIT_FAILURE);
+    }
+    p->free_blocks = NULL;
+    p->num_blocks = 0;
+    pool_grow(p, (bag_size + BAG_BLOCK_SIZE - 1) / BAG_BLOCK_SIZE);
+    return p;
+}
+
+//Bags of the pool must have been freed
+void free_bag_pool(bag_pool *p) {
+    bag_block *blk;
+    while((blk = p->free_blocks) != NULL) {
+        p->free_blocks = blk->next;
+        free(blk);
+    }
+    free(p);
+}
+
+static bag_block *pool_take(bag_pool *p) {
+    //As many blocks again, so that it seldom happens
+    if(p->free_blocks == NULL)
+        pool_grow(p, p->num_blocks > 0 ? p->num_blocks : 1);
+
+    bag_block *blk = p->free_blocks;
+    p->free_blocks = blk->next;
+    blk->next = NULL;
+    blk->count = 0;
+    return blk;
+}
+
+static void pool_put(bag_pool *p, bag_block *blk) {
+    blk->next = p->free_blocks;
+    p->free_blocks = blk;
+}
+
+bag* create_bag(bag_pool *p) {
     bag* b = malloc(sizeof(bag));
-    b->elems = (NODE_TYPE**) malloc(sizeof(NODE_TYPE*) * bag_size);
-    if(b->elems == NULL) {
-        fprintf(stderr, "Could not allocate bag of size %d\n", bag_size);
+    if(b == NULL) {
+        fprintf(stderr, "Could not allocate bag\n");
         exit(EXIT_FAILURE);
-    } 
+    }
 
-    b->bag_size = bag_size;
     b->curr_in_bag = 0;
+    b->head = NULL;
+    b->tail = NULL;
+    b->pool = p;
     return b;
 }
 
+//Its blocks go back to the pool
 void free_bag(bag* b) {
-    free(b->elems);
+    bag_block *blk;
+    while((blk = b->head) != NULL) {
+        b->head = blk->next;
+        pool_put(b->pool, blk);
+    }
     free(b);
 }
 
-//Insert new elem e in end of bag, grow if needed
+//Insert new elem e in the bag, returns 1 if it took a block from the pool
 int put(bag *b, NODE_TYPE* e) {
     int ret = 0;
-    if(b->curr_in_bag == b->bag_size) {
+    if(b->head == NULL || b->head->count == BAG_BLOCK_SIZE) {
+        bag_block *blk = pool_take(b->pool);
+        blk->next = b->head;
+        if(b->head == NULL)
+            b->tail = blk;
+        b->head = blk;
         ret = 1;
-        grow(b);
     }
 
-    b->elems[b->curr_in_bag++] = e;
+    b->head->elems[b->head->count++] = e;
+    b->curr_in_bag++;
     return ret;
 }
 
 //Removes one element from bag
 NODE_TYPE* take(bag *b) {
-    NODE_TYPE* ret = NULL;
-    if(b->curr_in_bag > 0)
-        ret = b->elems[--b->curr_in_bag];
-    return ret;
-}
-
-/* Transfers elements from src to dest
-If dest's bag does not have enough space to hold src, dest grows
-Removes src bag's items  */
-int transfer(bag *dest, bag *src) {
-    int ret = 0;
-
-    while(dest->bag_size - dest->curr_in_bag < src->curr_in_bag) {
-        ret = 1;
-        grow(dest);
+    bag_block *blk;
+    //Spliced in bags may leave empty blocks in front
+    while((blk = b->head) != NULL && blk->count == 0) {
+        b->head = blk->next;
+        if(b->head == NULL)
+            b->tail = NULL;
+        pool_put(b->pool, blk);
     }
+    if(blk == NULL)
+        return NULL;
 
-    //Transfer elems
-    memcpy(dest->elems + dest->curr_in_bag,
-        src->elems, src->curr_in_bag * sizeof(NODE_TYPE*));
+    b->curr_in_bag--;
+    return blk->elems[--blk->count];
+}
 
-    dest->curr_in_bag += src->curr_in_bag; //Grow dest size
-    src->curr_in_bag = 0; //*Empty* src
+/* Moves all elements from src to dest, by linking src's blocks in front
+of dest's. Returns how many were moved */
+int transfer(bag *dest, bag *src) {
+    int moved = src->curr_in_bag;
+    if(src->head == NULL)
+        return 0;
 
-    return ret;
-}
+    src->tail->next = dest->head;
+    if(dest->head == NULL)
+        dest->tail = src->tail;
+    dest->head = src->head;
+    dest->curr_in_bag += moved;
 
-//Grows bag to GROWTH_FACTOR times its current size
-void grow(bag *b) {
-    b->bag_size = b->bag_size * GROWTH_FACTOR;
-    b->elems = realloc(b->elems, b->bag_size * sizeof(NODE_TYPE*));
-    if(b->elems == NULL) {
-        fprintf(stderr, "Could not grow bag to size %d\n", b->bag_size);
-        exit(EXIT_FAILURE);
-    } 
+    src->head = NULL;
+    src->tail = NULL;
+    src->curr_in_bag = 0;
+    return moved;
 }
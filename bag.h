@@ -11,20 +11,39 @@
     #define NODE_TYPE uintptr_t
 #endif
 
-#define GROWTH_FACTOR 2
+//Elements of a block, so that one is 512 bytes
+#define BAG_BLOCK_SIZE 62
+
+typedef struct bag_block bag_block;
+struct bag_block {
+    bag_block *next;
+    int count; //number of elements in this block
+    NODE_TYPE* elems[BAG_BLOCK_SIZE];
+};
+
+/* Blocks the bags of a thread are made of. Emptied blocks go back to it and
+ * are reused: bags never realloc, and only take more memory from the
+ * system when all the blocks of the pool are in use */
+typedef struct bag_pool bag_pool;
+struct bag_pool {
+    bag_block *free_blocks;
+    int num_blocks; //number of blocks allocated so far
+};
 
 typedef struct bag bag;
 struct bag {
     int curr_in_bag; //number of elements currently in the bag
-    int bag_size; //maximum number of elements in the bag
-    NODE_TYPE** elems;
+    bag_block *head; //block put and take work on
+    bag_block *tail; //so that transfer() splices without walking the blocks
+    bag_pool *pool;
 };
 
-bag* create_bag(int bag_size);
+bag_pool* create_bag_pool(int bag_size);
+void free_bag_pool(bag_pool *p);
+bag* create_bag(bag_pool *p);
 void free_bag(bag* b);
 int put(bag *b, NODE_TYPE* e);
 NODE_TYPE* take(bag *b);
 int transfer(bag *dest, bag *src);
-void grow(bag *b);
 
 #endif
@@ -21,20 +21,27 @@
 #define CAS(p, e, d) atomic_compare_exchange_weak(p, e, d)
 
 //Initialize global structure that coordinates epochs
-ebr* init_ebr(int num_threads, void (*reclaim)(void*)) {
-    ebr* r = (ebr*) malloc(sizeof(ebr));
+ebr* init_ebr(int num_threads, void (*reclaim)(void*), void (*reclaim_batch)(void**, int)) {
+    ebr* r = NULL;
+    if(posix_memalign((void**) &r, EBR_CACHE_LINE, sizeof(ebr)) != 0
+        || posix_memalign((void**) &r->records, EBR_CACHE_LINE, num_threads * sizeof(ebr_record)) != 0) {
+        fprintf(stderr, "Failed to allocate the epoch records\n");
+        exit(EXIT_FAILURE);
+    }
     r->curr_epoch = 1;
-    r->announcements = calloc(num_threads, sizeof(uint64_t));
-    r->quiescent_bits = calloc(num_threads, sizeof(bool));
+    //Threads that did not start (yet) must not hold epochs back
+    for(int i = 0; i < num_threads; ++i)
+        r->records[i].state = EBR_STATE(0, true);
+    r->laggard = 0;
     r->num_threads = num_threads;
     r->reclaim = reclaim;
+    r->reclaim_batch = reclaim_batch;
     return r;
 }
 
 //Free ebr structure
 void free_ebr(ebr* r) {
-    free(r->announcements);
-    free(r->quiescent_bits);
+    free(r->records);
     free(r);
 }
 
@@ -42,15 +49,16 @@ void free_ebr(ebr* r) {
 reclamation* init_reclamation(ebr* r, int tid, size_t bag_sizes) {
     reclamation* recl = (reclamation*) malloc(sizeof(reclamation));
     recl->r = r;
-    recl->announcement = &(r->announcements[tid]);
-    recl->quiescent_bit = &(r->quiescent_bits[tid]);
-    *(recl->quiescent_bit) = true;
+    recl->record = &r->records[tid];
+    recl->record->state = EBR_STATE(0, true);
 
+    //Room for bag_sizes items in each bag before the pool has to grow
+    recl->pool = create_bag_pool(4 * bag_sizes);
     recl->limbo_bags = (bag**) malloc(3 * sizeof(bag*));
     for(int i = 0; i < 3; ++i)
-        recl->limbo_bags[i] = create_bag(bag_sizes);
+        recl->limbo_bags[i] = create_bag(recl->pool);
 
-    recl->to_be_reclaimed = create_bag(bag_sizes);
+    recl->to_be_reclaimed = create_bag(recl->pool);
 
     return recl;
 }
@@ -77,6 +85,7 @@ void free_reclamation(reclamation* recl) {
     free(recl->limbo_bags);
 
     free_bag(recl->to_be_reclaimed);
+    free_bag_pool(recl->pool);
 
     free(recl);
 }
@@ -85,18 +94,16 @@ void free_reclamation(reclamation* recl) {
 //EBR assumes that when this is called no non-retired object's pointer is held
 void announce_epoch(reclamation* recl) {
     uint64_t curr_epoch = recl->r->curr_epoch;
-    assert(*recl->announcement <= curr_epoch);
-
-    leave_quiescent(recl);
+    uint64_t announced = EBR_EPOCH(recl->record->state);
+    assert(announced <= curr_epoch);
 
     if(curr_epoch >= 2)
         empty_oldest_limbo(recl, curr_epoch - 2);
 
-    if(curr_epoch > *recl->announcement) {
-        //Updated threads' epoch by announcing the current epoch
-        (*recl->announcement) = curr_epoch;
+    //Leaves quiescence and announces in a single write
+    recl->record->state = EBR_STATE(curr_epoch, false);
+    if(curr_epoch > announced)
         reclaim(recl); //Epoch was advanced, can reclaim e-2
-    }
 
     if(try_advance_epoch(recl->r))
         reclaim(recl); //Epoch was advanced, can reclaim e-2
@@ -112,15 +119,28 @@ int try_advance_epoch(ebr* r) {
     return 0;
 }
 
+//Whether thread i holds back the epoch from advancing past curr_epoch
+static inline bool holds_back(ebr* r, int i, uint64_t curr_epoch) {
+    uint64_t state = r->records[i].state;
+    return !(state & EBR_QUIESCENT) && EBR_EPOCH(state) < curr_epoch;
+}
+
 //Check if the epoch can has been announced by all threads
 int can_advance_epoch(ebr* r) {
     int n = r->num_threads;
-    int curr_epoch = r->curr_epoch;
+    //This is safe because curr_epoch is a local variable.
+    //Even if r->curr_epoch is updated concurrently,
+    //the result is still correct
+    uint64_t curr_epoch = r->curr_epoch;
+
+    //Most of the time the thread that was behind still is, one line to read
+    int laggard = r->laggard;
+    if(holds_back(r, laggard, curr_epoch))
+        return 0;
+
     for(int i = 0; i < n; ++i) {
-        //This is safe because curr_epoch is a local variable.
-        //Even if r->curr_epoch is updated concurrently,
-        //the result is still correct
-        if(r->announcements[i] < curr_epoch && !r->quiescent_bits[i]) {
+        if(i != laggard && holds_back(r, i, curr_epoch)) {
+            r->laggard = i;
             return 0; /* Can not advance current epoch */
         }
     }
@@ -167,9 +187,13 @@ NODE_TYPE* get_safe_to_reclaim(reclamation* recl) {
 }
 
 //Reclaims all items that are safe to reclaim
+//  those for the custom reclaimer go to reclaim_batch in groups, if set
 void reclaim(reclamation *recl) {
     NODE_TYPE *n;
     void (*reclaim_func)(void*);
+    void (*reclaim_batch)(void**, int) = recl->r->reclaim_batch;
+    void *batch[EBR_RECLAIM_BATCH];
+    int nbatch = 0;
 
     while((n = get_safe_to_reclaim(recl)) != NULL) {
 		if(is_os_marked_reference(n)) {
@@ -177,6 +201,15 @@ void reclaim(reclamation *recl) {
 			reclaim_func = OS_RECLAIM;
 			n = (void*) get_unmarked_reference(n);
 
+		} else if(reclaim_batch != NULL) {
+            batch[nbatch++] = n;
+            if(nbatch == EBR_RECLAIM_BATCH) {
+                (*reclaim_batch)(batch, nbatch);
+                nbatch = 0;
+            }
+            recl->total_reclaimed++;
+            continue;
+
 		} else {
 			//Reclaim to custom reclaimer function
 			reclaim_func = CUSTOM_RECLAIM;
@@ -185,30 +218,51 @@ void reclaim(reclamation *recl) {
         (*reclaim_func)(n);
         recl->total_reclaimed++;
     }
+
+    if(nbatch > 0)
+        (*reclaim_batch)(batch, nbatch);
 }
 
 //"Stop messing" with the data-structure
 void enter_quiescent(reclamation *recl) {
-    *(recl->quiescent_bit) = true;
-
 	//Advance epoch so that threads that are
 	//	activelly trying to reclaim can do so
     uint64_t curr_epoch = recl->r->curr_epoch;
-    if(curr_epoch > *recl->announcement) {
+    uint64_t announced = EBR_EPOCH(recl->record->state);
+    if(curr_epoch > announced) {
         //Updated threads' epoch by announcing the current epoch
-        (*recl->announcement) = curr_epoch;
+        recl->record->state = EBR_STATE(curr_epoch, true);
         reclaim(recl); //Epoch was advanced, can reclaim e-2
+    } else {
+        recl->record->state = EBR_STATE(announced, true);
     }
 }
 
 //"Start messing" with the data-structure
 void leave_quiescent(reclamation *recl) {
-    *(recl->quiescent_bit) = false;
+    recl->record->state &= ~(uint64_t) EBR_QUIESCENT;
 }
 
 
 bool is_quiescent(reclamation *recl) {
-    return *(recl->quiescent_bit);
+    return recl->record->state & EBR_QUIESCENT;
+}
+
+//Whether items it retired are still waiting to be reclaimed
+bool has_retired(reclamation *recl) {
+    for(int i = 0; i < 3; i++) {
+        if(recl->limbo_bags[i]->curr_in_bag > 0)
+            return true;
+    }
+    return recl->to_be_reclaimed->curr_in_bag > 0;
+}
+
+//How many items it retired are still waiting to be reclaimed
+uint64_t count_retired(reclamation *recl) {
+    uint64_t n = recl->to_be_reclaimed->curr_in_bag;
+    for(int i = 0; i < 3; i++)
+        n += recl->limbo_bags[i]->curr_in_bag;
+    return n;
 }
 
 void print_info(ebr* r, reclamation* recl) {
@@ -216,7 +270,8 @@ void print_info(ebr* r, reclamation* recl) {
 
     printf("announcs: ");
     for(int i = 0; i < r->num_threads; i++)
-        printf("%ld ", r->announcements[i]);
+        printf("%ld%s ", EBR_EPOCH(r->records[i].state),
+            (r->records[i].state & EBR_QUIESCENT) ? "q" : "");
 
     if(recl != NULL) {
         printf("reclaimed: %d ", recl->to_be_reclaimed->curr_in_bag);
@@ -11,29 +11,44 @@
 #include "bag.h"
 
 
+#define EBR_CACHE_LINE 64
+
+//A thread's announced epoch and whether it is quiescent, in one word
+//  only the thread writes. A line each, so threads do not write each
+//  other's lines when they announce
+typedef struct {
+    volatile uint64_t state;
+} __attribute__((aligned(EBR_CACHE_LINE))) ebr_record;
+
+#define EBR_QUIESCENT 1
+#define EBR_EPOCH(s) ((s) >> 1)
+#define EBR_STATE(epoch, quiescent) (((epoch) << 1) | ((quiescent) ? EBR_QUIESCENT : 0))
+
 typedef struct ebr ebr;
 //Global ebr struct
 struct ebr {
     volatile uint64_t curr_epoch;
-    uint64_t *announcements;
     int num_threads;
-    bool *quiescent_bits;
     void (*reclaim)(void*);
+    void (*reclaim_batch)(void**, int); //reclaim for several at once (optional)
+    ebr_record *records;
+    //Thread that held the epoch back last time, checked first
+    volatile int laggard __attribute__((aligned(EBR_CACHE_LINE)));
 };
 
 typedef struct reclamation reclamation;
 //Thread's view of ebr
 struct reclamation {
     ebr *r;
-    uint64_t *announcement;
-    volatile bool *quiescent_bit;
+    ebr_record *record;
+    bag_pool* pool; /* Blocks of the bags below */
     bag** limbo_bags;
     bag* to_be_reclaimed; /* Reclaimed items */
     uint32_t total_reclaimed;
 };
 
 
-ebr* init_ebr(int num_threads, void (*reclaim)(void*));
+ebr* init_ebr(int num_threads, void (*reclaim)(void*), void (*reclaim_batch)(void**, int));
 void free_ebr(ebr* r);
 reclamation* init_reclamation(ebr* r, int tid, size_t bag_sizes);
 void free_reclamation(reclamation* recl);
@@ -50,6 +65,8 @@ void reclaim(reclamation *recl);
 void enter_quiescent(reclamation *recl);
 void leave_quiescent(reclamation *recl);
 bool is_quiescent(reclamation *recl);
+bool has_retired(reclamation *recl);
+uint64_t count_retired(reclamation *recl);
 
 void print_info(ebr* r, reclamation* recl);
 
@@ -66,6 +83,9 @@ void print_info(ebr* r, reclamation* recl);
 #define CUSTOM_RECLAIM		recl->r->reclaim
 #define CUSTOM_TYPE			1
 
+//Items reclaim() hands to reclaim_batch at once, at most
+#define EBR_RECLAIM_BATCH 64
+
 //Reclaim to Operating System (normal free)
 #define OS_RECLAIM			&free
 #define OS_TYPE				2
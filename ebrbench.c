@@ -0,0 +1,142 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Microbenchmark of the epoch based reclamation (ebr.c).
+ *
+ * Every thread runs what a worker does around its commands: it leaves
+ * quiescence, retires an object now and then, enters quiescence again and
+ * announces the epoch, so that it advances and the retired objects are
+ * reclaimed. Each round adds threads, and the operations per second they
+ * get together show how much they slow each other down by writing and
+ * reading the epoch records. Needs a multi-core box to mean anything:
+ *
+ *   ./ebrbench [max threads] [seconds per round]
+ */
+#include "memcached.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+//One object retired every RETIRE_EVERY operations
+#define RETIRE_EVERY 4
+//Epoch announced every ANNOUNCE_EVERY operations
+#define ANNOUNCE_EVERY 64
+//Objects each thread retires in turn, far more than stay in limbo
+#define OBJECTS 4096
+#define OPS_BATCH 1024
+
+typedef struct {
+    pthread_t thread;
+    int tid;
+    ebr *r;
+    uint64_t ops;
+    uint64_t reclaimed;
+} __attribute__((aligned(EBR_CACHE_LINE))) bench_thread;
+
+static volatile bool stop = false;
+
+//The objects are the thread's own, they are only counted (reclaim())
+static void reclaim_object(void *p) {
+    (void) p;
+}
+
+static void *bench_thread_run(void *arg) {
+    bench_thread *me = arg;
+    reclamation *recl = init_reclamation(me->r, me->tid, OBJECTS / RETIRE_EVERY);
+    uint64_t *objects = calloc(OBJECTS, sizeof(uint64_t));
+    uint64_t ops = 0;
+
+    if (objects == NULL) {
+        fprintf(stderr, "Failed to allocate the objects\n");
+        exit(EXIT_FAILURE);
+    }
+    enter_quiescent(recl);
+
+    while (!stop) {
+        for (int i = 0; i < OPS_BATCH; i++, ops++) {
+            leave_quiescent(recl);
+            if (ops % RETIRE_EVERY == 0)
+                add_retired_item(recl, (item*) &objects[(ops / RETIRE_EVERY) % OBJECTS], CUSTOM_TYPE);
+            enter_quiescent(recl);
+            if (ops % ANNOUNCE_EVERY == 0) {
+                announce_epoch(recl);
+                enter_quiescent(recl);
+            }
+        }
+    }
+
+    me->ops = ops;
+    me->reclaimed = recl->total_reclaimed;
+    free_reclamation(recl);
+    free(objects);
+    return NULL;
+}
+
+static void bench_round(const int nthreads, const unsigned int seconds) {
+    bench_thread *threads;
+    ebr *r = init_ebr(nthreads, &reclaim_object, NULL);
+    uint64_t epoch = r->curr_epoch;
+    uint64_t ops = 0, reclaimed = 0;
+
+    if (posix_memalign((void**) &threads, EBR_CACHE_LINE, nthreads * sizeof(bench_thread)) != 0) {
+        fprintf(stderr, "Failed to allocate the threads\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(threads, 0, nthreads * sizeof(bench_thread));
+
+    stop = false;
+    for (int i = 0; i < nthreads; i++) {
+        threads[i].tid = i;
+        threads[i].r = r;
+        if (pthread_create(&threads[i].thread, NULL, bench_thread_run, &threads[i]) != 0) {
+            fprintf(stderr, "Failed to start thread %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    sleep(seconds);
+    stop = true;
+
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        ops += threads[i].ops;
+        reclaimed += threads[i].reclaimed;
+    }
+
+    printf("%d\t%.2f\t\t%.2f\t\t%llu\t%llu\n", nthreads,
+        (double) ops / seconds / 1e6, (double) ops / seconds / 1e6 / nthreads,
+        (unsigned long long) (r->curr_epoch - epoch),
+        (unsigned long long) reclaimed);
+
+    free(threads);
+    free_ebr(r);
+}
+
+int main(int argc, char **argv) {
+    long max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int seconds = 2;
+
+    if (argc > 1)
+        max_threads = atol(argv[1]);
+    if (argc > 2)
+        seconds = atoi(argv[2]);
+    if (max_threads < 1 || seconds < 1) {
+        fprintf(stderr, "Usage: %s [max threads] [seconds per round]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("threads\tMops/s\t\tMops/s/thread\tepochs\treclaimed\n");
+    //Doubling the threads, the last round with max_threads
+    for (long n = 1; ; n *= 2) {
+        if (n > max_threads)
+            n = max_threads;
+        bench_round(n, seconds);
+        if (n == max_threads)
+            break;
+    }
+
+    return EXIT_SUCCESS;
+}
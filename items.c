@@ -52,9 +52,11 @@ static unsigned int *stats_sizes_hist = NULL;
 static uint64_t stats_sizes_cas_min = 0;
 static int stats_sizes_buckets = 0;
 static uint64_t cas_id = 0;
+//New key the admission filter dropped, the request that tried to store
+//  it may still read it. Never published, so the next allocation frees it
+static __thread item *rejected_item = NULL;
 
 static volatile int do_run_lru_maintainer_thread = 0;
-static pthread_mutex_t cas_id_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t stats_sizes_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void item_stats_reset(void) {
@@ -66,18 +68,12 @@ void item_stats_reset(void) {
 }
 
 /* Get the next CAS id for a new item. */
-/* TODO: refactor some atomics for this. */
 uint64_t get_cas_id(void) {
-    pthread_mutex_lock(&cas_id_lock);
-    uint64_t next_id = ++cas_id;
-    pthread_mutex_unlock(&cas_id_lock);
-    return next_id;
+    return __atomic_add_fetch(&cas_id, 1, __ATOMIC_RELAXED);
 }
 
 void set_cas_id(uint64_t new_cas) {
-    pthread_mutex_lock(&cas_id_lock);
-    cas_id = new_cas;
-    pthread_mutex_unlock(&cas_id_lock);
+    __atomic_store_n(&cas_id, new_cas, __ATOMIC_RELAXED);
 }
 
 int item_is_flushed(item *it) {
@@ -128,6 +124,11 @@ static size_t item_make_header(const uint8_t nkey, const unsigned int flags, con
 
 item *do_item_alloc_pull(const size_t ntotal, const unsigned int id) {
     item *it = NULL;
+    //Callers holding item references (append, incr) must not announce a
+    //  newer epoch, those items could be reclaimed under them. Between
+    //  commands workers hold none, even if they are not quiescent
+    const bool holds_items = ebr_in_command;
+    bool swept = false;
 
     int retries = 10;
     for (; retries > 0; retries--) {
@@ -135,18 +136,60 @@ item *do_item_alloc_pull(const size_t ntotal, const unsigned int id) {
         if(it != NULL)
             break;
 
-        //advance epoch to try to reclaim previously removed items
-        ebr_announce_epoch();
+        //-M: only what was removed already can go back to the slabs
+        if (!settings.evict_to_free) {
+            if (!holds_items) {
+                ebr_reclaim_retired();
+                it = slabs_alloc(ntotal, id, 0);
+                ebr_enter_quiescent();
+            }
+            break;
+        }
 
-        /* Try to reclaim memory first */
-        try_evict(id, ntotal, 0); 
+        //The evictor keeps class id stocked from now on
+        assoc_evictor_want(id);
 
+        //Victims only return to the slabs once the caller holds no items, so
+        //  one sweep will do: more would only wear down the hot items' CLOCK
+        if (holds_items) {
+            if (!swept)
+                item_stats_evictions(id, try_evict(id, ntotal, 0), false);
+            swept = true;
+            continue;
+        }
+
+        //What was removed so far goes back to the slabs first, then evict
+        //  from class id and get the victims back before trying again
+        ebr_reclaim_retired();
+        it = slabs_alloc(ntotal, id, 0);
+        if (it == NULL) {
+            int n = try_evict(id, ntotal, 0);
+            item_stats_evictions(id, n, false);
+            if (n > 0)
+                ebr_reclaim_retired();
+        }
         ebr_enter_quiescent();
+
+        if (it != NULL)
+            break;
     }
 
     return it;
 }
 
+/* Memory for a new key the admission filter is going to drop: a free
+ * chunk, or one of those already removed, rather than a victim evicted
+ * for nothing. NULL if there are none */
+static item *do_item_alloc_free(const size_t ntotal, const unsigned int id) {
+    item *it = slabs_alloc(ntotal, id, 0);
+    if (it == NULL && !ebr_in_command) {
+        ebr_reclaim_retired();
+        it = slabs_alloc(ntotal, id, 0);
+        ebr_enter_quiescent();
+    }
+    return it;
+}
+
 /* Chain another chunk onto this chunk. */
 /* slab mover: if it finds a chunk without ITEM_CHUNK flag, and no ITEM_LINKED
  * flag, it counts as busy and skips.
@@ -210,15 +253,25 @@ item *do_item_alloc(const char *key, const size_t nkey, const unsigned int flags
     if (nbytes < 2)
         return 0;
 
+    if (rejected_item != NULL) {
+        item_free(rejected_item);
+        rejected_item = NULL;
+    }
+
     size_t ntotal = item_make_header(nkey + 1, flags, nbytes, suffix, &nsuffix);
     if (settings.use_cas) {
         ntotal += sizeof(uint64_t);
     }
+    if (assoc_sieve) {
+        ntotal += sizeof(uint64_t);
+    }
 
     unsigned int id = slabs_clsid(ntotal);
     unsigned int hdr_id = 0;
     if (id == 0)
         return 0;
+    /* Hashed once, admission, linking, unlinking and resizing reuse it */
+    const uint32_t hv = hash(key, nkey);
 
 
 
@@ -250,6 +303,9 @@ item *do_item_alloc(const char *key, const size_t nkey, const unsigned int flags
         if (settings.use_cas) {
             htotal += sizeof(uint64_t);
         }
+        if (assoc_sieve) {
+            htotal += sizeof(uint64_t);
+        }
 #ifdef NEED_ALIGN
         // header chunk needs to be padded on some systems
         int remain = htotal % 8;
@@ -263,7 +319,11 @@ item *do_item_alloc(const char *key, const size_t nkey, const unsigned int flags
         if (it != NULL)
             it->it_flags |= ITEM_CHUNKED;
     } else {
-        it = do_item_alloc_pull(ntotal, id);
+        //Keys that already exist are stored anyway, those get a victim
+        if (!assoc_admits(id, hv))
+            it = do_item_alloc_free(ntotal, id);
+        if (it == NULL)
+            it = do_item_alloc_pull(ntotal, id);
     }
 
     if (it == NULL) {
@@ -275,8 +335,9 @@ item *do_item_alloc(const char *key, const size_t nkey, const unsigned int flags
     assert(it->it_flags == 0 || it->it_flags == ITEM_CHUNKED);
     //assert(it != heads[id]);
 
-    /* Refcount is seeded to 1 by slabs_alloc() */
+    /* Refcount is seeded to 1 by slabs_alloc(), no response holds it yet */
     it->next = it->prev = 0;
+    it->refcount = 0;
 
     /* Items are initially loaded into the HOT_LRU. This is '0' but I want at
      * least a note here. Compiler (hopefully?) optimizes this out.
@@ -294,10 +355,15 @@ item *do_item_alloc(const char *key, const size_t nkey, const unsigned int flags
 
     DEBUG_REFCNT(it, '*');
     it->it_flags |= settings.use_cas ? ITEM_CAS : 0;
+    it->it_flags |= assoc_sieve ? ITEM_SIEVE : 0;
     it->it_flags |= nsuffix != 0 ? ITEM_CFLAGS : 0;
     it->nkey = nkey;
     it->nbytes = nbytes;
     memcpy(ITEM_key(it), key, nkey);
+    it->hv = hv;
+    it->idx_flags = 0;
+    it->clock_ref = 0;
+    it->sieve_state = 0;
     it->exptime = exptime;
     if (nsuffix > 0) {
         memcpy(ITEM_suffix(it), &flags, sizeof(flags));
@@ -318,11 +384,39 @@ item *do_item_alloc(const char *key, const size_t nkey, const unsigned int flags
     return it;
 }
 
+/* Whether a response still sends from its memory (resp_hold_item()). Then
+ * it goes back to the limbo of this thread to be tried again in a later
+ * epoch: no one else can find it any more, so the hold can only go away */
+static inline bool item_held(item *it) {
+    if (__atomic_load_n(&it->refcount, __ATOMIC_ACQUIRE) == 0)
+        return false;
+    ebr_add_retired_item(it, CUSTOM_TYPE);
+    return true;
+}
+
 void reclaim_item(void* p) {
     item* it = (item*) p;
+    if (item_held(it))
+        return;
+    //The SIEVE hand frees it
+    if (assoc_sieve_release(it))
+        return;
     item_free(it);
 }
 
+//reclaim_item() for n items, returned to the slabs together
+void reclaim_items(void** ps, const int n) {
+    item **its = (item **) ps;
+    int nfree = 0;
+    for (int i = 0; i < n; i++) {
+        if (item_held(its[i]) || assoc_sieve_release(its[i]))
+            continue;
+        DEBUG_REFCNT(its[i], 'F');
+        its[nfree++] = its[i];
+    }
+    slabs_free_items(its, nfree);
+}
+
 void item_free(item *it) {
     size_t ntotal = ITEM_ntotal(it);
     unsigned int clsid = ITEM_clsid(it);
@@ -338,6 +432,14 @@ void item_free(item *it) {
     slabs_free(it, ntotal, clsid);
 }
 
+/* Writes the value of an ITEM_NUMERIC item, \r\n included, to buf (at least
+ * ITEM_NUMERIC_LEN bytes). Returns its length, what nbytes would be */
+int item_numeric_render(item *it, char *buf) {
+    char *p = itoa_u64(__atomic_load_n(ITEM_counter(it), __ATOMIC_RELAXED), buf);
+    memcpy(p, "\r\n", 2);
+    return (p - buf) + 2;
+}
+
 /**
  * Returns true if an item will fit in the cache (its size does not exceed
  * the maximum for a cache entry.)
@@ -353,10 +455,24 @@ bool item_size_ok(const size_t nkey, const int flags, const int nbytes) {
     if (settings.use_cas) {
         ntotal += sizeof(uint64_t);
     }
+    if (assoc_sieve) {
+        ntotal += sizeof(uint64_t);
+    }
 
     return slabs_clsid(ntotal) != 0;
 }
 
+/* Whether the new key it may be linked (see assoc_admit()). If not, it is
+ * kept until the next allocation, which its memory goes to */
+bool do_item_admit(item *it, const uint32_t hv) {
+    if (assoc_admit(it, hv))
+        return true;
+    if (rejected_item != NULL)
+        item_free(rejected_item);
+    rejected_item = it;
+    return false;
+}
+
 int do_item_link(item *it, const uint32_t hv) {
     int res;
 
@@ -364,6 +480,7 @@ int do_item_link(item *it, const uint32_t hv) {
 
     //This might conflict if item removed and is being reinserted
     assert((it->it_flags & (ITEM_LINKED|ITEM_SLABBED)) == 0);
+
     it->it_flags |= ITEM_LINKED; 
 
     //This might conflict as well, but it should be OK to be approximated
@@ -376,12 +493,10 @@ int do_item_link(item *it, const uint32_t hv) {
     STATS_UNLOCK();
 
     /* Allocate a new CAS ID on link. */
-    //ITEM_set_cas(it, (settings.use_cas) ? get_cas_id() : 0);
+    ITEM_set_cas(it, (settings.use_cas) ? get_cas_id() : 0);
 
     res = assoc_insert(it, hv);
 
-    refcount_incr(it);
-
     item_stats_sizes_add(it);
 
     return res;
@@ -390,14 +505,15 @@ int do_item_link(item *it, const uint32_t hv) {
 void do_item_unlink(item *it, const uint32_t hv) {
     MEMCACHED_ITEM_UNLINK(ITEM_key(it), it->nkey, it->nbytes);
     if ((it->it_flags & ITEM_LINKED) != 0) { //TODO: remove?
-        STATS_LOCK();
-        stats_state.curr_bytes -= ITEM_ntotal(it);
-        stats_state.curr_items -= 1;
-        STATS_UNLOCK();
-
-        item_stats_sizes_remove(it);
-        
-        assoc_delete(ITEM_key(it), it->nkey, hv);
+        //Only whoever removes it from the table accounts for it
+        if (assoc_delete_item(it, hv)) {
+            STATS_LOCK();
+            stats_state.curr_bytes -= ITEM_ntotal(it);
+            stats_state.curr_items -= 1;
+            STATS_UNLOCK();
+
+            item_stats_sizes_remove(it);
+        }
 
         //This is likely useless and might conflict TODO: remove?
         it->it_flags &= ~ITEM_LINKED;
@@ -405,6 +521,18 @@ void do_item_unlink(item *it, const uint32_t hv) {
     }
 }
 
+/* it left the hash table without being unlinked (evicted, displaced by
+ * its engine): accounts for it as do_item_unlink() does */
+void do_item_dropped(item *it) {
+    STATS_LOCK();
+    stats_state.curr_bytes -= ITEM_ntotal(it);
+    stats_state.curr_items -= 1;
+    STATS_UNLOCK();
+
+    item_stats_sizes_remove(it);
+    it->it_flags &= ~ITEM_LINKED;
+}
+
 /* Bump the CLOCK value of item's table */
 void do_item_update(item *it, const uint32_t hv) {
     MEMCACHED_ITEM_UPDATE(ITEM_key(it), it->nkey, it->nbytes);
@@ -419,20 +547,72 @@ void do_item_update(item *it, const uint32_t hv) {
     assoc_bump(it, hv);
 }
 
-//#define MARK_REPLACEMENT //Wether to do mark replacement or not (def or ndef)
+/* new_it took the place of it in the hash table */
+static void do_item_replaced(item *it, item *new_it) {
+    it->it_flags &= ~ITEM_LINKED;
+    new_it->time = current_time;
+
+    STATS_LOCK();
+    stats_state.curr_bytes += ITEM_ntotal(new_it);
+    stats_state.curr_bytes -= ITEM_ntotal(it);
+    STATS_UNLOCK();
+
+    item_stats_sizes_remove(it);
+    item_stats_sizes_add(new_it);
+}
+
+//How the hash table swaps them is up to its engine (-o replace_algo for nblist).
+//  Returns 0, and new_it is not linked, if other changes of the key kept
+//  winning the race
 int do_item_replace(item *it, item *new_it, const uint32_t hv) {
     MEMCACHED_ITEM_REPLACE(ITEM_key(it), it->nkey, it->nbytes,
                            ITEM_key(new_it), new_it->nkey, new_it->nbytes);
     assert((it->it_flags & ITEM_SLABBED) == 0);
 
-#if !defined(MARK_REPLACEMENT) && !defined(POSTERIOR_INSERTION_REPLACEMENT)
-    do_item_unlink(it, hv);
-    return do_item_link(new_it, hv);
-#else
-    return assoc_replace(it, new_it, hv);
-#endif
+    //Linked before it can be found, so it can be unlinked
+    new_it->it_flags |= ITEM_LINKED;
+    ITEM_set_cas(new_it, (settings.use_cas) ? get_cas_id() : 0);
+    if (!assoc_replace(it, new_it, hv)) {
+        new_it->it_flags &= ~ITEM_LINKED;
+        return 0;
+    }
+
+    do_item_replaced(it, new_it);
+    return 1;
 }
 
+/* do_item_replace, as long as it is still in the hash table. Returns 0,
+ * and new_it is not linked, if it was replaced or unlinked meanwhile */
+int do_item_replace_if(item *it, item *new_it, const uint32_t hv) {
+    MEMCACHED_ITEM_REPLACE(ITEM_key(it), it->nkey, it->nbytes,
+                           ITEM_key(new_it), new_it->nkey, new_it->nbytes);
+    assert((it->it_flags & ITEM_SLABBED) == 0);
+
+    new_it->it_flags |= ITEM_LINKED;
+    ITEM_set_cas(new_it, (settings.use_cas) ? get_cas_id() : 0);
+    if (!assoc_replace_if(it, new_it, hv)) {
+        new_it->it_flags &= ~ITEM_LINKED;
+        return 0;
+    }
+
+    do_item_replaced(it, new_it);
+    return 1;
+}
+
+
+//Accounts for n items evicted to free chunks of class id, by the background
+//  evictor or by an allocation itself (direct)
+void item_stats_evictions(const unsigned int id, const uint64_t n, const bool background) {
+    if (n == 0)
+        return;
+    __atomic_fetch_add(&itemstats[id].evicted, n, __ATOMIC_RELAXED);
+    STATS_LOCK();
+    if (background)
+        stats.evictor_evictions += n;
+    else
+        stats.direct_evictions += n;
+    STATS_UNLOCK();
+}
 
 void item_stats_totals(ADD_STAT add_stats, void *c) {
     itemstats_t totals;
@@ -716,12 +896,9 @@ void item_stats_sizes(ADD_STAT add_stats, void *c) {
     mutex_unlock(&stats_sizes_lock);
 }
 
-/** wrapper around assoc_find which does the lazy expiration logic */
-item *do_item_get(const char *key, const size_t nkey, const uint32_t hv, LIBEVENT_THREAD *t, const bool do_update) {
-    item *it = assoc_find(key, nkey, hv);
+/** lazy expiration logic for an item assoc_find returned */
+static item *do_item_get_found(item *it, const char *key, const size_t nkey, const uint32_t hv, LIBEVENT_THREAD *t, const bool do_update) {
     if (it != NULL) {
-        refcount_incr(it);
-
         /* Optimization for slab reassignment. prevents popular items from
          * jamming in busy wait. Can only do this here to satisfy lock order
          * of item_lock, slabs_lock. */
@@ -806,12 +983,69 @@ item *do_item_get(const char *key, const size_t nkey, const uint32_t hv, LIBEVEN
     return it;
 }
 
+/** wrapper around assoc_find which does the lazy expiration logic */
+item *do_item_get(const char *key, const size_t nkey, const uint32_t hv, LIBEVENT_THREAD *t, const bool do_update) {
+    return do_item_get_found(assoc_find(key, nkey, hv), key, nkey, hv, t, do_update);
+}
+
+/** do_item_get for n keys, looked up together (see assoc_find_batch) */
+void do_item_get_batch(const char **keys, const size_t *nkeys, const uint32_t *hvs, const int n,
+                       LIBEVENT_THREAD *t, const bool do_update, item **its) {
+    assoc_find_batch(keys, nkeys, hvs, n, its);
+    for (int i = 0; i < n; i++) {
+        its[i] = do_item_get_found(its[i], keys[i], nkeys[i], hvs[i], t, do_update);
+    }
+}
+
 // Requires lock held for item.
 // Split out of do_item_get() to allow mget functions to look through header
 // data before losing state modified via the bump function.
+static __thread unsigned int bump_hits = 0; //Of referenced items, for bump_sample
+
+//Whether a hit should write it (settings.bump_policy). Hot items are read
+//  by every worker, writing them on every hit bounces their cache lines
+static inline bool bump_wanted(const item *it) {
+    //Never skipped, the eviction hand would take it for unused
+    if (__atomic_load_n(&it->clock_ref, __ATOMIC_RELAXED) == 0)
+        return true;
+
+    switch (settings.bump_policy) {
+    case bump_interval:
+        return it->time + settings.bump_interval <= current_time;
+    case bump_sample:
+        return ++bump_hits % settings.bump_sample == 0;
+    default:
+        return true;
+    }
+}
+
 void do_item_bump(LIBEVENT_THREAD *t, item *it, const uint32_t hv) {
-    it->it_flags |= ITEM_FETCHED;
-    do_item_update(it, hv);
+    if (settings.bump_policy == bump_always) {
+        it->it_flags |= ITEM_FETCHED;
+        do_item_update(it, hv);
+        return;
+    }
+
+    //Test before writing, these are shared by every reader
+    bool wrote = false;
+    if (!(it->it_flags & ITEM_FETCHED)) {
+        it->it_flags |= ITEM_FETCHED;
+        wrote = true;
+    }
+    if (bump_wanted(it)) {
+        MEMCACHED_ITEM_UPDATE(ITEM_key(it), it->nkey, it->nbytes);
+        if (it->time != current_time) {
+            it->time = current_time;
+            wrote = true;
+        }
+        wrote |= assoc_bump(it, hv);
+    }
+
+    if (!wrote) {
+        pthread_mutex_lock(&t->stats.mutex);
+        t->stats.bumps_skipped++;
+        pthread_mutex_unlock(&t->stats.mutex);
+    }
 }
 
 item *do_item_touch(const char *key, size_t nkey, uint32_t exptime,
@@ -18,21 +18,27 @@ item *do_item_alloc(const char *key, const size_t nkey, const unsigned int flags
 item_chunk *do_item_alloc_chunk(item_chunk *ch, const size_t bytes_remain);
 item *do_item_alloc_pull(const size_t ntotal, const unsigned int id);
 void reclaim_item(void* p);
+void reclaim_items(void** ps, const int n);
 void item_free(item *it);
+int item_numeric_render(item *it, char *buf);
 bool item_size_ok(const size_t nkey, const int flags, const int nbytes);
 
+bool do_item_admit(item *it, const uint32_t hv);
 int  do_item_link(item *it, const uint32_t hv);     /** may fail if transgresses limits */
 void do_item_unlink(item *it, const uint32_t hv);
+void do_item_dropped(item *it);
 void do_item_unlink_nolock(item *it, const uint32_t hv);
 void do_item_remove(item *it);
 void do_item_update(item *it, const uint32_t hv); /** update LRU time to current and reposition */
 void do_item_update_nolock(item *it, const uint32_t hv);
 int  do_item_replace(item *it, item *new_it, const uint32_t hv);
+int  do_item_replace_if(item *it, item *new_it, const uint32_t hv);
 
 int item_is_flushed(item *it);
 
 void item_stats(ADD_STAT add_stats, void *c);
 void item_stats_totals(ADD_STAT add_stats, void *c);
+void item_stats_evictions(const unsigned int id, const uint64_t n, const bool background);
 /*@null@*/
 void item_stats_sizes(ADD_STAT add_stats, void *c);
 void item_stats_sizes_init(void);
@@ -43,6 +49,8 @@ void item_stats_sizes_remove(item *it);
 bool item_stats_sizes_status(void);
 
 item *do_item_get(const char *key, const size_t nkey, const uint32_t hv, LIBEVENT_THREAD *t, const bool do_update);
+void do_item_get_batch(const char **keys, const size_t *nkeys, const uint32_t *hvs, const int n,
+                       LIBEVENT_THREAD *t, const bool do_update, item **its);
 item *do_item_touch(const char *key, const size_t nkey, uint32_t exptime, const uint32_t hv, LIBEVENT_THREAD *t);
 void do_item_bump(LIBEVENT_THREAD *t, item *it, const uint32_t hv);
 void item_stats_reset(void);
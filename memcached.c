@@ -56,6 +56,7 @@
 #include "proto_text.h"
 #include "proto_bin.h"
 #include "proto_proxy.h"
+#include "nblist.h"
 
 #if defined(__FreeBSD__)
 #include <sys/sysctl.h>
@@ -267,6 +268,16 @@ static void settings_init(void) {
     settings.temporary_ttl = 61;
     settings.idle_timeout = 0; /* disabled */
     settings.hashpower_init = 0;
+    settings.hash_shrink_pct = 0;
+    settings.chain_index_len = 0;
+    settings.replace_algo = "posterior";
+    settings.evictor_low_wm = 5;
+    settings.evictor_high_wm = 10;
+    settings.admission_filter = false;
+    settings.evict_algo = "clock";
+    settings.bump_policy = bump_always;
+    settings.bump_interval = ITEM_UPDATE_INTERVAL;
+    settings.bump_sample = 16;
     settings.slab_reassign = true;
     settings.slab_automove = 1;
     settings.slab_automove_ratio = 0.8;
@@ -504,6 +515,20 @@ static void conn_init(void) {
     }
 }
 
+static const char *bump_policy_text(enum bump_policy policy) {
+    switch (policy) {
+    case bump_always:
+        return "always";
+    case bump_test:
+        return "test";
+    case bump_interval:
+        return "interval";
+    case bump_sample:
+        return "sample";
+    }
+    return "unknown";
+}
+
 static const char *prot_text(enum protocol prot) {
     char *rv = "unknown";
     switch(prot) {
@@ -1012,11 +1037,25 @@ void conn_set_state(conn *c, enum conn_states state) {
 /*
  * response object helper functions
  */
-void resp_reset(mc_resp *resp) {
+
+/* The iovecs of the response may point into it, so its memory must not be
+ * reclaimed until the response is transmitted. Reclaiming leaves items
+ * with a refcount in limbo (reclaim_item()), the epoch is not held back */
+void resp_hold_item(mc_resp *resp, item *it) {
+    assert(resp->item == NULL);
+    refcount_incr(it);
+    resp->item = it;
+}
+
+static void resp_release_item(mc_resp *resp) {
     if (resp->item) {
-        item_remove(resp->item);
+        refcount_decr(resp->item);
         resp->item = NULL;
     }
+}
+
+void resp_reset(mc_resp *resp) {
+    resp_release_item(resp);
     if (resp->write_and_free) {
         free(resp->write_and_free);
         resp->write_and_free = NULL;
@@ -1220,11 +1259,8 @@ mc_resp *resp_start_unlinked(conn *c) {
 // returns next response in chain.
 mc_resp* resp_finish(conn *c, mc_resp *resp) {
     mc_resp *next = resp->next;
-    if (resp->item) {
-        // TODO: cache hash value in resp obj?
-        item_remove(resp->item);
-        resp->item = NULL;
-    }
+    // TODO: cache hash value in resp obj?
+    resp_release_item(resp);
     if (resp->write_and_free) {
         free(resp->write_and_free);
     }
@@ -1570,13 +1606,27 @@ static int _store_item_copy_data(int comm, item *old_it, item *new_it, item *add
     return 0;
 }
 
+/* Unlinked plain copy of a numeric item, to append or prepend to its value */
+static item *_store_item_plain_copy(item *it) {
+    char num[ITEM_NUMERIC_LEN];
+    uint32_t flags;
+    int nbytes = item_numeric_render(it, num);
+
+    FLAGS_CONV(it, flags);
+    item *plain = do_item_alloc(ITEM_key(it), it->nkey, flags, it->exptime, nbytes);
+    if (plain != NULL) {
+        memcpy(ITEM_data(plain), num, nbytes);
+    }
+    return plain;
+}
+
 /*
- * Stores an item in the cache according to the semantics of one of the set
- * commands. Protected by the item lock.
- *
- * Returns the state of storage.
+ * One attempt of do_store_item(). Sets *retry instead of storing if an
+ * append/prepend, or the replacement of a set, lost to another change of
+ * the item and last is false.
  */
-enum store_item_type do_store_item(item *it, int comm, LIBEVENT_THREAD *t, const uint32_t hv, uint64_t *cas, bool cas_stale) {
+static enum store_item_type _store_item_once(item *it, int comm, LIBEVENT_THREAD *t, const uint32_t hv, uint64_t *cas, bool cas_stale,
+                                             const bool last, bool *retry) {
     char *key = ITEM_key(it);
     item *old_it = do_item_get(key, it->nkey, hv, t, DONT_UPDATE);
     enum store_item_type stored = NOT_STORED;
@@ -1611,12 +1661,7 @@ enum store_item_type do_store_item(item *it, int comm, LIBEVENT_THREAD *t, const
                 break;
             case NREAD_CAS:
                 if (cas_res == CAS_MATCH) {
-                    // cas validates
-                    // it and old_it may belong to different classes.
-                    // I'm updating the stats for the one that's getting pushed out
-                    pthread_mutex_lock(&t->stats.mutex);
-                    t->stats.slab_stats[ITEM_clsid(old_it)].cas_hits++;
-                    pthread_mutex_unlock(&t->stats.mutex);
+                    // cas validates, hits are counted once it is stored
                     do_store = true;
                 } else if (cas_res == CAS_STALE) {
                     // if we're allowed to set a stale value, CAS must be lower than
@@ -1628,10 +1673,6 @@ enum store_item_type do_store_item(item *it, int comm, LIBEVENT_THREAD *t, const
                     if (old_it->it_flags & ITEM_TOKEN_SENT) {
                         it->it_flags |= ITEM_TOKEN_SENT;
                     }
-
-                    pthread_mutex_lock(&t->stats.mutex);
-                    t->stats.slab_stats[ITEM_clsid(old_it)].cas_hits++;
-                    pthread_mutex_unlock(&t->stats.mutex);
                     do_store = true;
                 } else {
                     // NONE or BADVAL are the same for CAS cmd
@@ -1654,19 +1695,31 @@ enum store_item_type do_store_item(item *it, int comm, LIBEVENT_THREAD *t, const
                     break;
                 }
 
+                /* numeric items are copied from their rendered value */
+                item *src_it = old_it;
+                if (old_it->it_flags & ITEM_NUMERIC) {
+                    src_it = _store_item_plain_copy(old_it);
+                    if (src_it == NULL)
+                        break;
+                }
+
                 /* we have it and old_it here - alloc memory to hold both */
                 FLAGS_CONV(old_it, flags);
-                new_it = do_item_alloc(key, it->nkey, flags, old_it->exptime, it->nbytes + old_it->nbytes - 2 /* CRLF */);
+                new_it = do_item_alloc(key, it->nkey, flags, old_it->exptime, it->nbytes + src_it->nbytes - 2 /* CRLF */);
 
                 // OOM trying to copy.
-                if (new_it == NULL)
-                    break;
-                /* copy data from it and old_it to new_it */
-                if (_store_item_copy_data(comm, old_it, new_it, it) == -1) {
+                int copied = -1;
+                if (new_it != NULL) {
+                    /* copy data from it and old_it to new_it */
+                    copied = _store_item_copy_data(comm, src_it, new_it, it);
+                }
+                if (src_it != old_it)
+                    item_free(src_it);
+
+                if (copied == -1) {
                     // failed data copy
                     break;
                 } else {
-                    // refcount of new_it is 1 here. will end up 2 after link.
                     // it's original ref is managed outside of this function
                     it = new_it;
                     do_store = true;
@@ -1679,9 +1732,39 @@ enum store_item_type do_store_item(item *it, int comm, LIBEVENT_THREAD *t, const
         }
 
         if (do_store) {
-            item_replace(old_it, it, hv);
-	    //item_free(it);
-            stored = STORED;
+            if (comm == NREAD_SET || comm == NREAD_REPLACE) {
+                if (item_replace(old_it, it, hv)) {
+                    stored = STORED;
+                } else if (!last) {
+                    // Other changes of the key kept winning, start over
+                    *retry = true;
+                    return NOT_STORED;
+                }
+            } else if (item_replace_if(old_it, it, hv)) {
+                // cas and append/prepend were checked against, or built
+                // from, old_it. They must not overwrite what replaced it
+                stored = STORED;
+            } else if (new_it != NULL && cas_res == CAS_NONE && !last) {
+                // Append/prepend to whatever replaced it instead
+                item_free(new_it);
+                *retry = true;
+                return NOT_STORED;
+            } else {
+                // Without a CAS it only lost too many times in a row
+                stored = cas_res == CAS_NONE ? NOT_STORED : EXISTS;
+            }
+
+            if (comm == NREAD_CAS) {
+                // it and old_it may belong to different classes.
+                // I'm updating the stats for the one that's getting pushed out
+                pthread_mutex_lock(&t->stats.mutex);
+                if (stored == STORED) {
+                    t->stats.slab_stats[ITEM_clsid(old_it)].cas_hits++;
+                } else {
+                    t->stats.slab_stats[ITEM_clsid(old_it)].cas_badval++;
+                }
+                pthread_mutex_unlock(&t->stats.mutex);
+            }
         }
 
         //do_item_remove(old_it);         /* release our reference */
@@ -1715,7 +1798,8 @@ enum store_item_type do_store_item(item *it, int comm, LIBEVENT_THREAD *t, const
                 break;
         }
 
-        if (do_store) {
+        //New keys the admission filter drops are NOT_STORED
+        if (do_store && do_item_admit(it, hv)) {
             do_item_link(it, hv);
             stored = STORED;
         }
@@ -1728,6 +1812,30 @@ enum store_item_type do_store_item(item *it, int comm, LIBEVENT_THREAD *t, const
             stored, comm, ITEM_key(it), it->nkey, it->nbytes, it->exptime,
             ITEM_clsid(it), t->cur_sfd);
 
+    // The append/prepend copy that could not replace old_it
+    if (new_it != NULL && stored != STORED)
+        item_free(new_it);
+
+    return stored;
+}
+
+/*
+ * Stores an item in the cache according to the semantics of one of the set
+ * commands. Protected by the item lock.
+ *
+ * Returns the state of storage.
+ */
+enum store_item_type do_store_item(item *it, int comm, LIBEVENT_THREAD *t, const uint32_t hv, uint64_t *cas, bool cas_stale) {
+    enum store_item_type stored;
+    int tries = 0;
+    bool retry;
+
+    do {
+        retry = false;
+        stored = _store_item_once(it, comm, t, hv, cas, cas_stale,
+                                  ++tries == STORE_ITEM_RETRIES, &retry);
+    } while (retry);
+
     return stored;
 }
 
@@ -1840,6 +1948,7 @@ void server_stats(ADD_STAT add_stats, conn *c) {
     APPEND_STAT("touch_misses", "%llu", (unsigned long long)thread_stats.touch_misses);
     APPEND_STAT("store_too_large", "%llu", (unsigned long long)thread_stats.store_too_large);
     APPEND_STAT("store_no_memory", "%llu", (unsigned long long)thread_stats.store_no_memory);
+    APPEND_STAT("bumps_skipped", "%llu", (unsigned long long)thread_stats.bumps_skipped);
     APPEND_STAT("auth_cmds", "%llu", (unsigned long long)thread_stats.auth_cmds);
     APPEND_STAT("auth_errors", "%llu", (unsigned long long)thread_stats.auth_errors);
     if (settings.idle_timeout) {
@@ -1856,6 +1965,11 @@ void server_stats(ADD_STAT add_stats, conn *c) {
     APPEND_STAT("hash_power_level", "%u", stats_state.hash_power_level);
     APPEND_STAT("hash_bytes", "%llu", (unsigned long long)stats_state.hash_bytes);
     APPEND_STAT("hash_is_expanding", "%u", stats_state.hash_is_expanding);
+    APPEND_STAT("hash_chain_indexes", "%llu", (unsigned long long)stats_state.hash_chain_indexes);
+    assoc_replace_stats(add_stats, c);
+    APPEND_STAT("evictor_evictions", "%llu", (unsigned long long)stats.evictor_evictions);
+    APPEND_STAT("direct_evictions", "%llu", (unsigned long long)stats.direct_evictions);
+    assoc_admission_stats(add_stats, c);
     if (settings.slab_reassign) {
         APPEND_STAT("slab_reassign_rescues", "%llu", stats.slab_reassign_rescues);
         APPEND_STAT("slab_reassign_chunk_rescues", "%llu", stats.slab_reassign_chunk_rescues);
@@ -1942,6 +2056,17 @@ void process_stat_settings(ADD_STAT add_stats, void *c) {
     APPEND_STAT("flush_enabled", "%s", settings.flush_enabled ? "yes" : "no");
     APPEND_STAT("dump_enabled", "%s", settings.dump_enabled ? "yes" : "no");
     APPEND_STAT("hash_algorithm", "%s", settings.hash_algorithm);
+    APPEND_STAT("assoc_engine", "%s", settings.assoc_engine);
+    APPEND_STAT("hash_shrink_pct", "%d", settings.hash_shrink_pct);
+    APPEND_STAT("chain_index_len", "%d", settings.chain_index_len);
+    APPEND_STAT("replace_algo", "%s", settings.replace_algo);
+    APPEND_STAT("evictor_low_wm", "%d", settings.evictor_low_wm);
+    APPEND_STAT("evictor_high_wm", "%d", settings.evictor_high_wm);
+    APPEND_STAT("admission_filter", "%s", settings.admission_filter ? "yes" : "no");
+    APPEND_STAT("evict_algo", "%s", settings.evict_algo);
+    APPEND_STAT("bump_policy", "%s", bump_policy_text(settings.bump_policy));
+    APPEND_STAT("bump_interval", "%d", settings.bump_interval);
+    APPEND_STAT("bump_sample", "%d", settings.bump_sample);
     APPEND_STAT("lru_maintainer_thread", "%s", settings.lru_maintainer_thread ? "yes" : "no");
     APPEND_STAT("lru_segmented", "%s", settings.lru_segmented ? "yes" : "no");
     APPEND_STAT("hot_lru_pct", "%d", settings.hot_lru_pct);
@@ -2188,6 +2313,18 @@ item* limited_get(const char *key, size_t nkey, LIBEVENT_THREAD *t, uint32_t exp
     return it;
 }
 
+// limited_get for n keys at once, without touching. Each key costs a
+// cache miss or more, looking them up together overlaps those misses.
+void limited_get_batch(const char **keys, const size_t *nkeys, const int n, LIBEVENT_THREAD *t, bool do_update, item **its) {
+    item_get_batch(keys, nkeys, n, t, do_update, its);
+    for (int i = 0; i < n; i++) {
+        if (its[i] && its[i]->refcount > IT_REFCOUNT_LIMIT) {
+            item_remove(its[i]);
+            its[i] = NULL;
+        }
+    }
+}
+
 // Semantics are different than limited_get; since the item is returned
 // locked, caller can directly change what it needs.
 // though it might eventually be a better interface to sink it all into
@@ -2224,96 +2361,115 @@ enum delta_result_type do_add_delta(LIBEVENT_THREAD *t, const char *key, const s
                                     item **it_ret) {
     char *ptr;
     uint64_t value;
-    int res;
     item *it;
+    int tries = 0;
 
+retry:
     it = do_item_get(key, nkey, hv, t, DONT_UPDATE);
     if (!it) {
         return DELTA_ITEM_NOT_FOUND;
     }
 
-    /* Can't delta zero byte values. 2-byte are the "\r\n" */
-    /* Also can't delta for chunked items. Too large to be a number */
-    if (it->nbytes <= 2 || (it->it_flags & (ITEM_CHUNKED)) != 0) {
-        //do_item_remove(it);
-        return NON_NUMERIC;
-    }
-
     if (cas != NULL && *cas != 0 && ITEM_get_cas(it) != *cas) {
         //do_item_remove(it);
         return DELTA_ITEM_CAS_MISMATCH;
     }
 
-    ptr = ITEM_data(it);
+    if (it->it_flags & ITEM_NUMERIC) {
+        /* Updated in place, readers render whichever value they load.
+         * A CAS given is checked by swapping it for the new one, so that
+         * of deltas given the same CAS only one applies. The value and its
+         * CAS are not updated as one though: a delta without a CAS changes
+         * the value before the CAS, one with a CAS that races it may pass
+         * even though the value changed since the client read it. */
+        uint64_t *counter = ITEM_counter(it);
+        uint64_t new_cas = (settings.use_cas) ? get_cas_id() : 0;
 
-    if (!safe_strtoull(ptr, &value)) {
-        //do_item_remove(it);
-        return NON_NUMERIC;
-    }
+        /* We also need to fiddle it in the sizes tracker in case the tracking
+         * was enabled at runtime, since it relies on the CAS value to know
+         * whether to remove an item or not. */
+        item_stats_sizes_remove(it);
+        if (cas != NULL && *cas != 0) {
+            uint64_t expected = *cas;
+            if (!__atomic_compare_exchange_n(&it->data->cas, &expected, new_cas, false,
+                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                item_stats_sizes_add(it);
+                return DELTA_ITEM_CAS_MISMATCH;
+            }
+        }
 
-    if (incr) {
-        value += delta;
-        //MEMCACHED_COMMAND_INCR(c->sfd, ITEM_key(it), it->nkey, value);
-    } else {
-        if(delta > value) {
-            value = 0;
+        if (incr) {
+            value = __atomic_add_fetch(counter, delta, __ATOMIC_RELAXED);
+            //MEMCACHED_COMMAND_INCR(c->sfd, ITEM_key(it), it->nkey, value);
         } else {
-            value -= delta;
+            uint64_t old = __atomic_load_n(counter, __ATOMIC_RELAXED);
+            do {
+                value = (uint64_t) delta > old ? 0 : old - delta;
+            } while (!__atomic_compare_exchange_n(counter, &old, value, true,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+            //MEMCACHED_COMMAND_DECR(c->sfd, ITEM_key(it), it->nkey, value);
         }
-        //MEMCACHED_COMMAND_DECR(c->sfd, ITEM_key(it), it->nkey, value);
-    }
 
-    pthread_mutex_lock(&t->stats.mutex);
-    if (incr) {
-        t->stats.slab_stats[ITEM_clsid(it)].incr_hits++;
-    } else {
-        t->stats.slab_stats[ITEM_clsid(it)].decr_hits++;
-    }
-    pthread_mutex_unlock(&t->stats.mutex);
-
-    itoa_u64(value, buf);
-    res = strlen(buf);
-    /* refcount == 2 means we are the only ones holding the item, and it is
-     * linked. We hold the item's lock in this function, so refcount cannot
-     * increase. */
-    if (res + 2 <= it->nbytes && it->refcount == 2) { /* replace in-place */
         /* When changing the value without replacing the item, we
            need to update the CAS on the existing item. */
-        /* We also need to fiddle it in the sizes tracker in case the tracking
-         * was enabled at runtime, since it relies on the CAS value to know
-         * whether to remove an item or not. */
-        item_stats_sizes_remove(it);
-        ITEM_set_cas(it, (settings.use_cas) ? get_cas_id() : 0);
+        if ((cas == NULL || *cas == 0) && (it->it_flags & ITEM_CAS))
+            __atomic_store_n(&it->data->cas, new_cas, __ATOMIC_RELEASE);
         item_stats_sizes_add(it);
-        memcpy(ITEM_data(it), buf, res);
-        memset(ITEM_data(it) + res, ' ', it->nbytes - res - 2);
         do_item_update(it, hv);
-    } else if (it->refcount > 1) {
+    } else {
+        /* Can't delta zero byte values. 2-byte are the "\r\n" */
+        /* Also can't delta for chunked items. Too large to be a number */
+        if (it->nbytes <= 2 || (it->it_flags & (ITEM_CHUNKED)) != 0) {
+            //do_item_remove(it);
+            return NON_NUMERIC;
+        }
+
+        ptr = ITEM_data(it);
+
+        if (!safe_strtoull(ptr, &value)) {
+            //do_item_remove(it);
+            return NON_NUMERIC;
+        }
+
+        if (incr) {
+            value += delta;
+        } else if ((uint64_t) delta > value) {
+            value = 0;
+        } else {
+            value -= delta;
+        }
+
+        /* First delta on this item: replace it with a numeric one, the
+         * following deltas update that one in place */
         item *new_it;
         uint32_t flags;
         FLAGS_CONV(it, flags);
-        new_it = do_item_alloc(ITEM_key(it), it->nkey, flags, it->exptime, res + 2);
+        new_it = do_item_alloc(ITEM_key(it), it->nkey, flags, it->exptime, ITEM_NUMERIC_BYTES);
         if (new_it == 0) {
             //do_item_remove(it);
             return EOM;
         }
-        memcpy(ITEM_data(new_it), buf, res);
-        memcpy(ITEM_data(new_it) + res, "\r\n", 2);
-        item_replace(it, new_it, hv);
-        // Overwrite the older item's CAS with our new CAS since we're
-        // returning the CAS of the old item below.
-        ITEM_set_cas(it, (settings.use_cas) ? ITEM_get_cas(new_it) : 0);
-        //do_item_remove(new_it);       /* release our reference */
-    } else {
-        /* Should never get here. This means we somehow fetched an unlinked
-         * item. TODO: Add a counter? */
-        if (settings.verbose) {
-            fprintf(stderr, "Tried to do incr/decr on invalid item\n");
+        new_it->it_flags |= ITEM_NUMERIC;
+        *ITEM_counter(new_it) = value;
+        if (!item_replace_if(it, new_it, hv)) {
+            //Changed meanwhile, apply the delta to whatever replaced it
+            item_free(new_it);
+            if (++tries < STORE_ITEM_RETRIES)
+                goto retry;
+            return EOM; //Kept changing, fails like an allocation would
         }
-        if (it->refcount == 1)
-            //do_item_remove(it);
-        return DELTA_ITEM_NOT_FOUND;
+        it = new_it;
+    }
+
+    pthread_mutex_lock(&t->stats.mutex);
+    if (incr) {
+        t->stats.slab_stats[ITEM_clsid(it)].incr_hits++;
+    } else {
+        t->stats.slab_stats[ITEM_clsid(it)].decr_hits++;
     }
+    pthread_mutex_unlock(&t->stats.mutex);
+
+    itoa_u64(value, buf);
 
     if (cas) {
         *cas = ITEM_get_cas(it);    /* swap the incoming CAS value */
@@ -4051,12 +4207,44 @@ static void usage(void) {
            "                          disabled by default; very dangerous option.\n"
            "   - hash_algorithm:      the hash table algorithm\n"
            "                          default is murmur3 hash. options: jenkins, murmur3, xxh3\n"
+           "   - assoc_engine:        the hash table engine\n"
+           "                          default is nblist (lock-free chains). options: nblist,\n"
+           "                          tagged (cache line buckets with hash fingerprints),\n"
+           "                          solist (split-ordered list, expands without moving items)\n"
+           "   - hash_shrink_pct:     halve the hash table when it holds fewer items\n"
+           "                          per 100 buckets, never below its starting size.\n"
+           "                          0 disables shrinking (default: %d)\n"
+           "   - chain_index_len:     index the hash chains (nblist engine) that lookups\n"
+           "                          walk more items of. 0 disables (default: %d)\n"
+           "   - replace_algo:        how hash chains (nblist engine) replace items\n"
+           "                          default is posterior. options: posterior (insert\n"
+           "                          after the old item), mark (mark the old item, readers\n"
+           "                          wait for it), none (delete, then insert)\n"
+           "   - evictor_low_wm:      a background thread evicts from the slab classes\n"
+           "                          with fewer free chunks than this percent of a\n"
+           "                          page. 0 disables it (default: %d)\n"
+           "   - evictor_high_wm:     ... until they have this percent of a page free\n"
+           "                          (default: %d)\n"
+           "   - admission_filter:    store new keys only if they were looked up more\n"
+           "                          often than the items evicted for them (TinyLFU)\n"
+           "   - evict_algo:          how victims are picked. default is clock. options:\n"
+           "                          clock (hash table buckets in turn), sieve (slab\n"
+           "                          classes' items in the order they were stored)\n"
+           "   - bump_policy:         which hits write the item's access time and CLOCK\n"
+           "                          count. default is always. options: always, test\n"
+           "                          (only what changes), interval (not if used within\n"
+           "                          bump_interval), sample (one in bump_sample hits).\n"
+           "                          Items the eviction hand reset are always bumped\n"
+           "   - bump_interval:       seconds, for bump_policy interval (default: %d)\n"
+           "   - bump_sample:         hits, for bump_policy sample (default: %d)\n"
            "   - no_lru_crawler:      disable LRU Crawler background thread.\n"
            "   - lru_crawler_sleep:   microseconds to sleep between items\n"
            "                          default is %d.\n"
            "   - lru_crawler_tocrawl: max items to crawl per slab per run\n"
            "                          default is %u (unlimited)\n",
            flag_enabled_disabled(settings.maxconns_fast), settings.hashpower_init,
+           settings.hash_shrink_pct, settings.chain_index_len, settings.evictor_low_wm,
+           settings.evictor_high_wm, settings.bump_interval, settings.bump_sample,
            settings.lru_crawler_sleep, settings.lru_crawler_tocrawl);
     printf("   - read_buf_mem_limit:  limit in megabytes for connection read/response buffers.\n"
            "                          do not adjust unless you have high (20k+) conn. limits.\n"
@@ -4701,6 +4889,7 @@ int main (int argc, char **argv) {
     bool start_lru_crawler = true;
     //bool start_assoc_maint = true;
     enum hashfunc_type hash_type = MURMUR3_HASH;
+    enum assoc_engine_type assoc_type = ASSOC_NBLIST;
     uint32_t tocrawl;
     uint32_t slab_sizes[MAX_NUMBER_OF_SLAB_CLASSES];
     bool use_slab_sizes = false;
@@ -4722,6 +4911,17 @@ int main (int argc, char **argv) {
         SLAB_AUTOMOVE_WINDOW,
         TAIL_REPAIR_TIME,
         HASH_ALGORITHM,
+        ASSOC_ENGINE,
+        HASH_SHRINK_PCT,
+        CHAIN_INDEX_LEN,
+        REPLACE_ALGO,
+        EVICTOR_LOW_WM,
+        EVICTOR_HIGH_WM,
+        ADMISSION_FILTER,
+        EVICT_ALGO,
+        BUMP_POLICY,
+        BUMP_INTERVAL,
+        BUMP_SAMPLE,
         LRU_CRAWLER,
         LRU_CRAWLER_SLEEP,
         LRU_CRAWLER_TOCRAWL,
@@ -4784,6 +4984,17 @@ int main (int argc, char **argv) {
         [SLAB_AUTOMOVE_WINDOW] = "slab_automove_window",
         [TAIL_REPAIR_TIME] = "tail_repair_time",
         [HASH_ALGORITHM] = "hash_algorithm",
+        [ASSOC_ENGINE] = "assoc_engine",
+        [HASH_SHRINK_PCT] = "hash_shrink_pct",
+        [CHAIN_INDEX_LEN] = "chain_index_len",
+        [REPLACE_ALGO] = "replace_algo",
+        [EVICTOR_LOW_WM] = "evictor_low_wm",
+        [EVICTOR_HIGH_WM] = "evictor_high_wm",
+        [ADMISSION_FILTER] = "admission_filter",
+        [EVICT_ALGO] = "evict_algo",
+        [BUMP_POLICY] = "bump_policy",
+        [BUMP_INTERVAL] = "bump_interval",
+        [BUMP_SAMPLE] = "bump_sample",
         [LRU_CRAWLER] = "lru_crawler",
         [LRU_CRAWLER_SLEEP] = "lru_crawler_sleep",
         [LRU_CRAWLER_TOCRAWL] = "lru_crawler_tocrawl",
@@ -5295,6 +5506,135 @@ int main (int argc, char **argv) {
                     return 1;
                 }
                 break;
+            case ASSOC_ENGINE:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing assoc_engine argument\n");
+                    return 1;
+                };
+                if (strcmp(subopts_value, "nblist") == 0) {
+                    assoc_type = ASSOC_NBLIST;
+                } else if (strcmp(subopts_value, "tagged") == 0) {
+                    assoc_type = ASSOC_TAGGED;
+                } else if (strcmp(subopts_value, "solist") == 0) {
+                    assoc_type = ASSOC_SOLIST;
+                } else {
+                    fprintf(stderr, "Unknown assoc_engine option (nblist, tagged, solist)\n");
+                    return 1;
+                }
+                break;
+            case HASH_SHRINK_PCT:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for hash_shrink_pct\n");
+                    return 1;
+                }
+                settings.hash_shrink_pct = atoi(subopts_value);
+                //Well below what any engine expands at, so it does not flip back
+                if (settings.hash_shrink_pct < 0 || settings.hash_shrink_pct > 50) {
+                    fprintf(stderr, "hash_shrink_pct must be between 0 and 50\n");
+                    return 1;
+                }
+                break;
+            case CHAIN_INDEX_LEN:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for chain_index_len\n");
+                    return 1;
+                }
+                if (!safe_strtol(subopts_value, &settings.chain_index_len) || settings.chain_index_len < 0) {
+                    fprintf(stderr, "chain_index_len must be 0 or more\n");
+                    return 1;
+                }
+                break;
+            case REPLACE_ALGO:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing replace_algo argument\n");
+                    return 1;
+                };
+                if (strcmp(subopts_value, "posterior") == 0) {
+                    settings.replace_algo = "posterior";
+                } else if (strcmp(subopts_value, "mark") == 0) {
+                    settings.replace_algo = "mark";
+                } else if (strcmp(subopts_value, "none") == 0) {
+                    settings.replace_algo = "none";
+                } else {
+                    fprintf(stderr, "Unknown replace_algo option (posterior, mark, none)\n");
+                    return 1;
+                }
+                break;
+            case EVICTOR_LOW_WM:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for evictor_low_wm\n");
+                    return 1;
+                }
+                if (!safe_strtol(subopts_value, &settings.evictor_low_wm)) {
+                    fprintf(stderr, "could not parse argument to evictor_low_wm\n");
+                    return 1;
+                }
+                break;
+            case EVICTOR_HIGH_WM:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for evictor_high_wm\n");
+                    return 1;
+                }
+                if (!safe_strtol(subopts_value, &settings.evictor_high_wm)) {
+                    fprintf(stderr, "could not parse argument to evictor_high_wm\n");
+                    return 1;
+                }
+                break;
+            case ADMISSION_FILTER:
+                settings.admission_filter = true;
+                break;
+            case EVICT_ALGO:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing evict_algo argument\n");
+                    return 1;
+                };
+                if (strcmp(subopts_value, "clock") == 0) {
+                    settings.evict_algo = "clock";
+                } else if (strcmp(subopts_value, "sieve") == 0) {
+                    settings.evict_algo = "sieve";
+                } else {
+                    fprintf(stderr, "Unknown evict_algo option (clock, sieve)\n");
+                    return 1;
+                }
+                break;
+            case BUMP_POLICY:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing bump_policy argument\n");
+                    return 1;
+                };
+                if (strcmp(subopts_value, "always") == 0) {
+                    settings.bump_policy = bump_always;
+                } else if (strcmp(subopts_value, "test") == 0) {
+                    settings.bump_policy = bump_test;
+                } else if (strcmp(subopts_value, "interval") == 0) {
+                    settings.bump_policy = bump_interval;
+                } else if (strcmp(subopts_value, "sample") == 0) {
+                    settings.bump_policy = bump_sample;
+                } else {
+                    fprintf(stderr, "Unknown bump_policy option (always, test, interval, sample)\n");
+                    return 1;
+                }
+                break;
+            case BUMP_INTERVAL:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for bump_interval\n");
+                    return 1;
+                }
+                if (!safe_strtol(subopts_value, &settings.bump_interval) || settings.bump_interval < 0) {
+                    fprintf(stderr, "bump_interval must be 0 or more\n");
+                    return 1;
+                }
+                break;
+            case BUMP_SAMPLE:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing numeric argument for bump_sample\n");
+                    return 1;
+                }
+                if (!safe_strtol(subopts_value, &settings.bump_sample) || settings.bump_sample < 1) {
+                    fprintf(stderr, "bump_sample must be 1 or more\n");
+                    return 1;
+                }
+                break;
             case LRU_CRAWLER:
                 start_lru_crawler = true;
                 break;
@@ -5712,6 +6052,12 @@ int main (int argc, char **argv) {
         meta->slab_config = "1.25";
     }
 
+    if (settings.evictor_low_wm < 0 || settings.evictor_low_wm > settings.evictor_high_wm
+        || settings.evictor_high_wm > 100) {
+        fprintf(stderr, "evictor watermarks must be 0 <= evictor_low_wm <= evictor_high_wm <= 100\n");
+        exit(EX_USAGE);
+    }
+
     if (settings.hot_lru_pct + settings.warm_lru_pct > 80) {
         fprintf(stderr, "hot_lru_pct + warm_lru_pct cannot be more than 80%% combined\n");
         exit(EX_USAGE);
@@ -5967,7 +6313,7 @@ int main (int argc, char **argv) {
     // We override the hash table start argument with what was live
     // previously, to avoid filling a huge set of items into a tiny hash
     // table.
-    assoc_init(settings.hashpower_init);
+    assoc_init(settings.hashpower_init, assoc_type);
 
     slabs_init(settings.maxbytes, settings.factor, preallocate,
             use_slab_sizes ? slab_sizes : NULL, mem_base, reuse_mem);
@@ -21,6 +21,7 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <assert.h>
+#include <stddef.h>
 #include <grp.h>
 #include <signal.h>
 /* need this to get IOV_MAX on some platforms. */
@@ -92,6 +93,10 @@
 #define HASHPOWER_DEFAULT 16
 #define HASHPOWER_MAX 32
 
+/* Times a store is redone after another change of the key won the race
+ * (append/prepend, deltas, replacements in a hash chain), before giving up */
+#define STORE_ITEM_RETRIES 10
+
 /*
  * We only reposition items in the LRU queue if they haven't been repositioned
  * in this many seconds. That saves us from churning on frequently-accessed
@@ -127,20 +132,36 @@
     } \
 }
 
+/* SIEVE queue link (assoc_sieve.c), after the CAS if there is one */
+#define ITEM_sieve_next(item) ((struct _stritem **) ((char*) &((item)->data) \
+         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0)))
+
 #define ITEM_key(item) (((char*)&((item)->data)) \
-         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0))
+         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0) \
+         + (((item)->it_flags & ITEM_SIEVE) ? sizeof(uint64_t) : 0))
 
 #define ITEM_suffix(item) ((char*) &((item)->data) + (item)->nkey + 1 \
-         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0))
+         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0) \
+         + (((item)->it_flags & ITEM_SIEVE) ? sizeof(uint64_t) : 0))
 
 #define ITEM_data(item) ((char*) &((item)->data) + (item)->nkey + 1 \
          + (((item)->it_flags & ITEM_CFLAGS) ? sizeof(uint32_t) : 0) \
-         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0))
+         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0) \
+         + (((item)->it_flags & ITEM_SIEVE) ? sizeof(uint64_t) : 0))
 
 #define ITEM_ntotal(item) (sizeof(struct _stritem) + (item)->nkey + 1 \
          + (item)->nbytes \
          + (((item)->it_flags & ITEM_CFLAGS) ? sizeof(uint32_t) : 0) \
-         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0))
+         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0) \
+         + (((item)->it_flags & ITEM_SIEVE) ? sizeof(uint64_t) : 0))
+
+/* ITEM_NUMERIC items keep their value as a 64 bit counter inside the data,
+ * aligned wherever the data starts. It is rendered to ASCII on read */
+#define ITEM_counter(item) ((uint64_t *) (((uintptr_t) ITEM_data(item) \
+         + sizeof(uint64_t) - 1) & ~(uintptr_t) (sizeof(uint64_t) - 1)))
+#define ITEM_NUMERIC_BYTES (2 * sizeof(uint64_t) - 1)
+/* Longest rendering of a counter: 20 digits and \r\n */
+#define ITEM_NUMERIC_LEN 22
 
 #define ITEM_clsid(item) ((item)->slabs_clsid & ~(3<<6))
 #define ITEM_lruid(item) ((item)->slabs_clsid & (3<<6))
@@ -234,6 +255,15 @@ enum protocol {
 #endif
 };
 
+/* Which hits write the item's fetched flag, access time and CLOCK count
+ * (-o bump_policy). All but always skip the writes that change nothing */
+enum bump_policy {
+    bump_always,   /* Every hit writes all of them */
+    bump_test,     /* Only what a hit changes */
+    bump_interval, /* Referenced items accessed less than bump_interval ago are left alone */
+    bump_sample,   /* Referenced items are bumped by one in bump_sample hits */
+};
+
 enum network_transport {
     local_transport, /* Unix sockets*/
     tcp_transport,
@@ -330,7 +360,8 @@ struct slab_stats {
     X(response_obj_bytes) \
     X(read_buf_oom) \
     X(store_too_large) \
-    X(store_no_memory)
+    X(store_no_memory) \
+    X(bumps_skipped) /* hits that did not write the item (bump_policy) */
 
 #ifdef EXTSTORE
 #define EXTSTORE_THREAD_STATS_FIELDS \
@@ -390,6 +421,8 @@ struct stats {
     uint64_t      slab_reassign_busy_deletes; /* refcounted items killed */
     uint64_t      lru_crawler_starts; /* Number of item crawlers kicked off */
     uint64_t      lru_maintainer_juggles; /* number of LRU bg pokes */
+    uint64_t      evictor_evictions; /* items the background evictor evicted */
+    uint64_t      direct_evictions; /* items allocations had to evict themselves */
     uint64_t      time_in_listen_disabled_us;  /* elapsed time in microseconds while server unable to process new connections */
     uint64_t      log_worker_dropped; /* logs dropped by worker threads */
     uint64_t      log_worker_written; /* logs written by worker threads */
@@ -418,6 +451,7 @@ struct stats_state {
     uint64_t      curr_bytes;
     uint64_t      curr_conns;
     uint64_t      hash_bytes;       /* size used for hash tables */
+    uint64_t      hash_chain_indexes; /* hash chains with an index */
     unsigned int  conn_structs;
     unsigned int  reserved_fds;
     unsigned int  hash_power_level; /* Better hope it's not over 9000 */
@@ -477,6 +511,17 @@ struct settings {
     bool flush_enabled;     /* flush_all enabled */
     bool dump_enabled;      /* whether cachedump/metadump commands work */
     char *hash_algorithm;     /* Hash algorithm in use */
+    const char *assoc_engine; /* Hash table engine in use */
+    int hash_shrink_pct;    /* Halve the hash table below this many items per 100 buckets */
+    int chain_index_len;    /* Index hash chains that lookups walk more items of */
+    const char *replace_algo; /* How nblist chains replace items */
+    const char *evict_algo; /* How victims are picked (clock, sieve) */
+    int evictor_low_wm;     /* Evict in the background below this many free chunks (% of a page) */
+    int evictor_high_wm;    /* ... until this many are free */
+    bool admission_filter;  /* Link new keys only if more popular than what is evicted */
+    enum bump_policy bump_policy; /* Which hits write the item's access state */
+    int bump_interval;      /* Seconds a referenced item's bumps are skipped for (interval) */
+    int bump_sample;        /* Hits a referenced item is bumped for one in (sample) */
     int lru_crawler_sleep;  /* Microsecond sleep between items */
     uint32_t lru_crawler_tocrawl; /* Number of items to crawl per run */
     int hot_lru_pct; /* percentage of slab space for HOT_LRU */
@@ -570,21 +615,36 @@ extern struct settings settings;
 #define ITEM_STALE 2048
 /* if item key was sent in binary */
 #define ITEM_KEY_BINARY 4096
+/* value is a counter updated in place by incr/decr, see ITEM_counter */
+#define ITEM_NUMERIC 8192
+/* additional 8 bytes for the SIEVE queue link, see ITEM_sieve_next */
+#define ITEM_SIEVE 16384
 
 /**
  * Structure for storing items within memcached.
  */
 typedef struct _stritem {
     struct _stritem *next;
-    struct _stritem *prev;
+    union {
+        struct _stritem *prev;  /* slab freelist only */
+        struct {                /* from allocation until freed */
+            uint32_t    hv;     /* hash value of the key */
+            union {             /* owned by the hash table engine */
+                uint32_t so_key;    /* split order key, while linked (assoc_solist.c) */
+                uint32_t idx_flags; /* sampled by a chain index (assoc.c) */
+            };
+        };
+    };
 
     rel_time_t      time;       /* least recent access */
     rel_time_t      exptime;    /* expire time */
     int             nbytes;     /* size of data */
-    unsigned short  refcount;
+    unsigned short  refcount;   /* responses holding it (resp_hold_item) */
     uint16_t        it_flags;   /* ITEM_* above */
     uint8_t         slabs_clsid;/* which slab class we're in */
     uint8_t         nkey;       /* key length, w/terminating null and padding */
+    uint8_t         clock_ref;  /* recent uses, for CLOCK (assoc_engine.h) */
+    uint8_t         sieve_state;/* in the SIEVE queue, reclaimed (assoc_sieve.c) */
     /* this odd type prevents type-punning issues when we do
      * the little shuffle to save space when not using CAS. */
     union {
@@ -592,6 +652,7 @@ typedef struct _stritem {
         char end;
     } data[];
     /* if it_flags & ITEM_CAS we have 8 bytes CAS */
+    /* then if it_flags & ITEM_SIEVE 8 bytes SIEVE queue link */
     /* then null-terminated key */
     /* then " flags length\r\n" (no terminating null) */
     /* then data with terminating \r\n (no terminating null; it's binary!) */
@@ -623,25 +684,34 @@ typedef struct {
 } crawler;
 
 /* Header when an item is actually a chunk of another item. */
+/* The slab allocator reads refcount, it_flags and slabs_clsid of free and
+ * chunk memory through an item pointer, so they sit at the same offsets as
+ * in item (checked below). */
 typedef struct _strchunk {
     struct _strchunk *next;     /* points within its own chain. */
     struct _strchunk *prev;     /* can potentially point to the head. */
     struct _stritem  *head;     /* always points to the owner chunk */
     int              size;      /* available chunk space in bytes */
-    int              used;      /* chunk space used */
-    int              nbytes;    /* used. */
     unsigned short   refcount;  /* used? */
     uint16_t         it_flags;  /* ITEM_* above. */
     uint8_t          slabs_clsid; /* Same as above. */
     uint8_t          orig_clsid; /* For obj hdr chunks slabs_clsid is fake. */
+    int              used;      /* chunk space used */
+    int              nbytes;    /* used. */
     char data[];
 } item_chunk;
 
+_Static_assert(offsetof(item_chunk, refcount) == offsetof(item, refcount)
+    && offsetof(item_chunk, it_flags) == offsetof(item, it_flags)
+    && offsetof(item_chunk, slabs_clsid) == offsetof(item, slabs_clsid),
+    "item_chunk header fields must overlay item's");
+
 #ifdef NEED_ALIGN
 static inline char *ITEM_schunk(item *it) {
     int offset = it->nkey + 1
         + ((it->it_flags & ITEM_CFLAGS) ? sizeof(uint32_t) : 0)
-        + ((it->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0);
+        + ((it->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0)
+        + ((it->it_flags & ITEM_SIEVE) ? sizeof(uint64_t) : 0);
     int remain = offset % 8;
     if (remain != 0) {
         offset += 8 - remain;
@@ -651,7 +721,8 @@ static inline char *ITEM_schunk(item *it) {
 #else
 #define ITEM_schunk(item) ((char*) &((item)->data) + (item)->nkey + 1 \
          + (((item)->it_flags & ITEM_CFLAGS) ? sizeof(uint32_t) : 0) \
-         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0))
+         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0) \
+         + (((item)->it_flags & ITEM_SIEVE) ? sizeof(uint64_t) : 0))
 #endif
 
 #ifdef EXTSTORE
@@ -970,11 +1041,13 @@ item *item_alloc(const char *key, size_t nkey, int flags, rel_time_t exptime, in
 #define DO_UPDATE true
 #define DONT_UPDATE false
 item *item_get(const char *key, const size_t nkey, LIBEVENT_THREAD *t, const bool do_update);
+void item_get_batch(const char **keys, const size_t *nkeys, const int n, LIBEVENT_THREAD *t, const bool do_update, item **its);
 item *item_get_locked(const char *key, const size_t nkey, LIBEVENT_THREAD *t, const bool do_update, uint32_t *hv);
 item *item_touch(const char *key, const size_t nkey, uint32_t exptime, LIBEVENT_THREAD *t);
 int   item_link(item *it);
 void  item_remove(item *it);
 int   item_replace(item *it, item *new_it, const uint32_t hv);
+int   item_replace_if(item *it, item *new_it, const uint32_t hv);
 void  item_unlink(item *it);
 
 void item_lock(uint32_t hv);
@@ -984,8 +1057,8 @@ void item_unlock(uint32_t hv);
 void pause_threads(enum pause_thread_types type);
 void stop_threads(void);
 int stop_conn_timeout_thread(void);
-#define refcount_incr(it) ++(it->refcount)
-#define refcount_decr(it) --(it->refcount)
+#define refcount_incr(it) __atomic_add_fetch(&(it)->refcount, 1, __ATOMIC_ACQ_REL)
+#define refcount_decr(it) __atomic_sub_fetch(&(it)->refcount, 1, __ATOMIC_ACQ_REL)
 void STATS_LOCK(void);
 void STATS_UNLOCK(void);
 #define THR_STATS_LOCK(t) pthread_mutex_lock(&t->stats.mutex)
@@ -1012,10 +1085,12 @@ void out_string(conn *c, const char *str);
         REALTIME_MAXDELTA + 1 : exptime
 rel_time_t realtime(const time_t exptime);
 item* limited_get(const char *key, size_t nkey, LIBEVENT_THREAD *t, uint32_t exptime, bool should_touch, bool do_update, bool *overflow);
+void limited_get_batch(const char **keys, const size_t *nkeys, const int n, LIBEVENT_THREAD *t, bool do_update, item **its);
 item* limited_get_locked(const char *key, size_t nkey, LIBEVENT_THREAD *t, bool do_update, uint32_t *hv, bool *overflow);
 // Read/Response object handlers.
 void resp_reset(mc_resp *resp);
 void resp_add_iov(mc_resp *resp, const void *buf, int len);
+void resp_hold_item(mc_resp *resp, item *it);
 void resp_add_chunked_iov(mc_resp *resp, const void *buf, int len);
 bool resp_start(conn *c);
 mc_resp *resp_start_unlinked(conn *c);
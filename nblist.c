@@ -4,6 +4,8 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stddef.h>
+#include <sched.h>
 
 
 /* Compare and Swap macro */
@@ -16,27 +18,61 @@
 //	#define CAS
 //#include "expbackoffcas.h"
 
+//Returned by searches that gave up, the tail (NULL) can not be used
+//	for this since it is a valid search result
+#define SEARCH_ABORTED ((item*) 0x1)
+
+//Indexed by tid, NULL until nblist_init_stats(). Only the thread counts
+//  in its own entry
+static replace_stats *stats_by_tid = NULL;
+static int stats_threads = 0;
+#define COUNT_REPLACE_STAT(field, n) do { \
+    if (stats_by_tid != NULL) stats_by_tid[tid].field += (n); } while (0)
+
+void nblist_init_stats(const int nthreads) {
+    stats_by_tid = calloc(nthreads, sizeof(replace_stats));
+    stats_threads = stats_by_tid != NULL ? nthreads : 0;
+}
+
+void nblist_replace_stats(replace_stats *totals) {
+    memset(totals, 0, sizeof(*totals));
+    for (int i = 0; i < stats_threads; i++) {
+        //UNSAFE
+        totals->retries += stats_by_tid[i].retries;
+        totals->waits += stats_by_tid[i].waits;
+        totals->helps += stats_by_tid[i].helps;
+    }
+}
+
+//Unlinked items go to EBR, after leaving any chain index that sampled
+//  them (assoc.c). Pairs with the fence of the index builder: either it
+//  sees the item marked and skips it, or we see it sampled
+static inline void retire_item(item *it) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&it->idx_flags, __ATOMIC_RELAXED) & IDX_SAMPLED)
+        nblist_unindex(it);
+    ebr_add_retired_item(it, CUSTOM_TYPE);
+}
+
 
 
 //Must only be called sequentially
 void free_list(List* l) {
-    item *n = l->head->next, *next = NULL;
-    while(n != l->tail && n != NULL) {
+    item *n = list_head(l)->next, *next = NULL;
+    while(n != list_tail(l)) {
         next = (item*) get_unmarked_reference(n->next);
         free(n);
         n = next;
     }
-    free(l->head);
-    free(l->tail);
     free(l);
 }
 
 void print_list(List * list) {
-    item* n = list->head;
-    item* next = list->head->next;
+    item* n = list_head(list);
+    item* next = list_head(list)->next;
     item* keep_real = next;
     int c = 0;
-    while(next != list->tail) {
+    while(next != list_tail(list)) {
         n = next;
         keep_real = n->next;
         //printf("%.*s:%ld:%d:%d:%d ",
@@ -53,30 +89,22 @@ void print_list(List * list) {
 }
 
 
-//Check if alignement of these 2 elements in 2 structs is the same
+//Check if alignement of next in struct item and in the inline
+//  head sentinel of struct List is the same
+//Only needs to be called once, the layout does not change at runtime
 bool check_alignment() {
-    item* it = (item*) malloc(sizeof(item));
-    fake_item* fake_it = (fake_item*) malloc(sizeof(fake_item));
-    uint8_t next_alignment = (long) &(it->next) - (long) it; 
-    uint8_t fake_next_alignment = (long) &(fake_it->next) - (long) fake_it; 
-    free(it);
-    free(fake_it);
-    return (next_alignment == fake_next_alignment);
+    return offsetof(item, next) == offsetof(List, next);
 }
 
 
-
+//Lists embedded in an array (e.g. hash table buckets) do not need this,
+//  a zero filled List is already a valid empty list
 List* new_nblist(void) {
-    if(!check_alignment()) {
-        fprintf(stderr, "Alignment of struct item and struct fake_item differs!");
-        exit(EXIT_FAILURE);
-    }
-	List *l = (List*) malloc(sizeof(List));
-	fake_item *head = (fake_item*) malloc(sizeof(fake_item));
-	fake_item *tail = (fake_item*) malloc(sizeof(fake_item));
-	l->head = (item*) head;
-	l->tail = (item*) tail;
-	head->next = l->tail;
+	List *l = (List*) calloc(1, sizeof(List));
+	if(l == NULL) {
+		fprintf(stderr, "Failed to allocate list\n");
+		exit(EXIT_FAILURE);
+	}
 	return l;
 }
 
@@ -84,12 +112,14 @@ List* new_nblist(void) {
 
 
 
-#ifdef MARK_REPLACEMENT //MARK REPLACEMENT------------------------------------------
-
 #define MAX_REPLACE_RETRIES 5000
+//Retries spent spinning before yielding to the replacing thread
+#define REPLACE_SPINS 16
 
-item* search(List* list, const char* search_key, const size_t nkey, item **left_item,
-    bool ignore_replacement) {
+//Items marked as being replaced (by replace_mark()) are waited for, unless
+//  ignore_replacement. The other algorithms never mark them
+item* search(List* list, const char* search_key, const size_t nkey, const uint32_t hv,
+    item **left_item, bool ignore_replacement) {
 
 	//NULL because of warnings
 	item *left_item_next = NULL, *right_item = NULL;
@@ -103,18 +133,23 @@ search_again:
 
         //We retried because of replace marking
         replace_retries++;
+        COUNT_REPLACE_STAT(waits, 1);
+        if(replace_retries > REPLACE_SPINS)
+            sched_yield(); //It may not be running
 
         if(replace_retries >= MAX_REPLACE_RETRIES) {
             //Thread replacing has likely crashed
             //  try and finish part of the job, i.e., delete old item
-            del_by_ref(list, right_item, true);
-            return NULL; //Did not find item, abort
+            bool found;
+            COUNT_REPLACE_STAT(helps, 1);
+            del_by_ref(list, right_item, true, &found);
+            return SEARCH_ABORTED; //Did not find item, abort
         }
     }
 
 	do {
-        item *t = list->head;
-        item *t_next = list->head->next; 
+        item *t = list_head(list);
+        item *t_next = list_head(list)->next; 
         int marked_counter = 0;
 
 		/* 1: Find left_item and right_item */
@@ -128,18 +163,18 @@ search_again:
             }
 
             t = (item *) get_unmarked_reference(t_next);
-            if (t == list->tail)
+            if (t == list_tail(list))
 				break;
             t_next = t->next;
         } while (is_marked_reference(t_next) ||
             //Compare keys
-            (KEY_cmp(ITEM_key(t), search_key, t->nkey, nkey) < 0)); /*B1*/
+            (HKEY_cmp(t, search_key, nkey, hv) < 0)); /*B1*/
 
         right_item = t; 
 		/* 2: Check items are adjacent */
         if (left_item_next == right_item) {
 
-            if ((right_item != list->tail) &&
+            if ((right_item != list_tail(list)) &&
                 (is_marked_reference(right_item->next) ||
                 (!ignore_replacement && is_marked_replacement_reference(right_item->next))))
                 goto search_again; /*G1*/
@@ -149,16 +184,17 @@ search_again:
 
  		/* 3: Remove one or more marked items */
         if (CAS(&((*left_item)->next), &left_item_next, right_item)) { /*C1*/
+            COUNT_REPLACE_STAT(helps, marked_counter);
             //Add one or more marked items to be reclaimed
             item *e = (item*) get_unmarked_reference(left_item_next);
             while(e != NULL && marked_counter > 0) {
-                ebr_add_retired_item(e, CUSTOM_TYPE);
+                retire_item(e);
                 assert(is_marked_reference(e->next));
                 e = (item*) get_unmarked_reference(e->next);
                 marked_counter--;
             }
 
-            if ((right_item != list->tail) &&
+            if ((right_item != list_tail(list)) &&
                 (is_marked_reference(right_item->next) ||
                 (!ignore_replacement && is_marked_replacement_reference(right_item->next))))
 				goto search_again; /*G2*/
@@ -168,71 +204,7 @@ search_again:
 
     } while (true); /*B2*/
 }
-//------------------------------------------MARK REPLACEMENT
-
-
-#else
-
 
-//POSTERIOR INSERTION REPLACEMENT---------------------------
-item* search(List* list, const char* search_key, const size_t nkey, item **left_item) {
-	//NULL because of warnings
-	item *left_item_next = NULL, *right_item;
-
-search_again:
-	do {
-        item *t = list->head;
-        item *t_next = list->head->next; 
-        int marked_counter = 0;
-
-		/* 1: Find left_item and right_item */
-        do {
-            if (!is_marked_reference(t_next)) {
-                (* left_item) = t;
-                left_item_next = t_next;
-                marked_counter = 0;
-            } else {
-                marked_counter++;
-            }
-
-            t = (item *) get_unmarked_reference(t_next);
-            if (t == list->tail)
-				break;
-            t_next = t->next;
-        } while (is_marked_reference(t_next) ||
-            //Compare keys
-            (KEY_cmp(ITEM_key(t), search_key, t->nkey, nkey) < 0)); /*B1*/
-
-        right_item = t; 
-		/* 2: Check items are adjacent */
-        if (left_item_next == right_item) {
-            if ((right_item != list->tail) && is_marked_reference(right_item->next))
-                goto search_again; /*G1*/
-			else
-				return right_item; /*R1*/
-		}
-
- 		/* 3: Remove one or more marked items */
-        if (CAS(&((*left_item)->next), &left_item_next, right_item)) { /*C1*/
-            //Add one or more marked items to be reclaimed
-            item *e = (item*) get_unmarked_reference(left_item_next);
-            while(e != NULL && marked_counter > 0) {
-                ebr_add_retired_item(e, CUSTOM_TYPE);
-                assert(is_marked_reference(e->next));
-                e = (item*) get_unmarked_reference(e->next);
-                marked_counter--;
-            }
-
-            if ((right_item != list->tail) && is_marked_reference(right_item->next))
-				goto search_again; /*G2*/
-            else
-		      	return right_item; /*R2*/
-		}
-
-    } while (true); /*B2*/
-}
-//---------------------------POSTERIOR INSERTION REPLACEMENT
-#endif 
 
 
 
@@ -244,8 +216,8 @@ int cleanup(List* list) {
     int total_items_removed = 0;
 
     do {
-        item * t = list->head;
-        item * t_next = list->head->next; 
+        item * t = list_head(list);
+        item * t_next = list_head(list)->next; 
 
         items_removed = 0;
 continue_cleanup:
@@ -256,7 +228,7 @@ continue_cleanup:
                 left_item_next = t_next;
             }
             t = (item *) get_unmarked_reference(t_next);
-            if (t == list->tail)
+            if (t == list_tail(list))
 				return total_items_removed; /* Did not find marked items */
             t_next = t->next;
         } while (!is_marked_reference(t_next));
@@ -265,7 +237,7 @@ continue_cleanup:
         while (is_marked_reference(t_next)) {
             items_removed++;
             t = (item *) get_unmarked_reference(t_next);
-            if (t == list->tail)
+            if (t == list_tail(list))
 				break;
             t_next = t->next;
         }
@@ -277,7 +249,7 @@ continue_cleanup:
             item *e = (item*) get_unmarked_reference(left_item_next);
             total_items_removed += items_removed;
             while(e != NULL && items_removed > 0) {
-                ebr_add_retired_item(e, CUSTOM_TYPE);
+                retire_item(e);
                 assert(is_marked_reference(e->next));
                 e = (item*) get_unmarked_reference(e->next);
                 items_removed--;
@@ -288,11 +260,24 @@ continue_cleanup:
     } while (true); /*B2*/
 }
 
+//Logically deletes it, returns false if it already was
+bool mark_node(item *it) {
+    item *it_next;
+
+    do {
+        it_next = it->next;
+        if (is_marked_reference(it_next))
+            return false;
+    } while (!CAS(&(it->next), &it_next, (item*) get_marked_reference(it_next)));
+
+    return true;
+}
+
 //Mark every node in list as logically deleted
 int __mark_all_nodes(List* list) {
     item *tail, *e, *e_next;
-    e = list->head->next;
-    tail = list->tail;
+    e = list_head(list)->next;
+    tail = list_tail(list);
     int marked_nodes = 0;
 
 	while (e != tail) {
@@ -319,21 +304,17 @@ int empty_list(List* list) {
 }
 
 bool is_empty(List *list) {
-    return list->head->next == list->tail;
+    return list_head(list)->next == list_tail(list);
 }
 
 bool insert(List *list, item *it) {
     item *right_item, *left_item;
 
     do {
-#ifdef MARK_REPLACEMENT
-        right_item = search(list, ITEM_key(it), it->nkey, &left_item, false);
-#else
-        right_item = search(list, ITEM_key(it), it->nkey, &left_item);
-#endif
-
-        if ((right_item == NULL) ||
-            ((right_item != list->tail) && (ITEM_cmp(right_item, it) == 0))) /*T1*/
+        right_item = search(list, ITEM_key(it), it->nkey, it->hv, &left_item, false);
+
+        if ((right_item == SEARCH_ABORTED) ||
+            ((right_item != list_tail(list)) && (ITEM_cmp(right_item, it) == 0))) /*T1*/
 			return false;
 
         it->next = right_item;
@@ -344,17 +325,13 @@ bool insert(List *list, item *it) {
     } while (true); /*B3*/
 }
 
-item* del(List* list, const char* search_key, const size_t nkey, bool reclaim, bool *found) {
+item* del(List* list, const char* search_key, const size_t nkey, const uint32_t hv, bool reclaim, bool *found) {
     item *right_item, *right_item_next, *left_item = NULL;
 
     do {
-#ifdef MARK_REPLACEMENT
-        right_item = search(list, search_key, nkey, &left_item, false);
-#else
-        right_item = search(list, search_key, nkey, &left_item);
-#endif
-        if ((right_item == NULL) || (right_item == list->tail) ||
-            (KEY_cmp(ITEM_key(right_item), search_key, right_item->nkey, nkey) != 0)) /*T1*/
+        right_item = search(list, search_key, nkey, hv, &left_item, false);
+        if ((right_item == SEARCH_ABORTED) || (right_item == list_tail(list)) ||
+            (HKEY_cmp(right_item, search_key, nkey, hv) != 0)) /*T1*/
             return NULL;
 
         right_item_next = right_item->next;
@@ -368,40 +345,36 @@ item* del(List* list, const char* search_key, const size_t nkey, bool reclaim, b
 
     *found = true;
 
-    if (!CAS(&(left_item->next), &right_item, right_item_next)) {/*C4*/
+    //Unmarked: right_item may be marked as being replaced, not left_item
+    if (!CAS(&(left_item->next), &right_item, (item*) get_unmarked_reference(right_item_next))) {/*C4*/
         right_item = (item*) get_unmarked_reference(right_item);
-#ifdef MARK_REPLACEMENT
-        right_item = search(list, ITEM_key(right_item), right_item->nkey, &left_item, false);
-#else
-        right_item = search(list, ITEM_key(right_item), right_item->nkey, &left_item);
-#endif
+        right_item = search(list, ITEM_key(right_item), right_item->nkey, right_item->hv, &left_item, false);
         return NULL;
     }
 
     /* add removed item to be reclaimed */
     if(reclaim)
-        ebr_add_retired_item(right_item, CUSTOM_TYPE);
+        retire_item(right_item);
 
     return right_item;
 }
 
 
-#ifdef MARK_REPLACEMENT //MARK REPLACEMENT------------------------------------------
 //Will return NULL if item was not found
 //  If item was not found, it was not inserted either, so if
 //  the objective is to insert it, insert should be called
-item* replace(List* list, const char* search_key, const size_t nkey, item *new_it,
-    bool reclaim, bool *inserted) {
+static item* replace_mark(List* list, const char* search_key, const size_t nkey, const uint32_t hv,
+    item *new_it, bool reclaim, bool *inserted) {
 
     item *right_item, *right_item_next, *left_item = NULL;
-    item *old_it; //Item to remove
+    item *old_it, *expected; //Item to remove
     *inserted = false;
 
     /* Mark old item as replaced */
     //Search for item to be replaced
-    right_item = search(list, search_key, nkey, &left_item, false);
-    if ((right_item == NULL) || (right_item == list->tail) ||
-        (KEY_cmp(ITEM_key(right_item), search_key, right_item->nkey, nkey) != 0)) {
+    right_item = search(list, search_key, nkey, hv, &left_item, false);
+    if ((right_item == SEARCH_ABORTED) || (right_item == list_tail(list)) ||
+        (HKEY_cmp(right_item, search_key, nkey, hv) != 0)) {
         //Item not found, try to do normal insert
 		//	TODO: try insert from the items we already found
 		//		  although this should be rare and have little impact
@@ -420,7 +393,8 @@ item* replace(List* list, const char* search_key, const size_t nkey, item *new_i
 				break; //If item has already been logically deleted;
 					   //	marked as "in replacement";
 					   //	or our marking succeeded, continue.
-						 
+
+        COUNT_REPLACE_STAT(retries, 1);
     } while (true);
 
 
@@ -432,24 +406,26 @@ item* replace(List* list, const char* search_key, const size_t nkey, item *new_i
 
         //Search for old item, ignoring replacement
         right_item = search_by_ref(list, old_it, &left_item, true);
-        assert(right_item == (item*) get_unmarked_reference(old_it) || right_item == list->tail);
+        assert(right_item == (item*) get_unmarked_reference(old_it) || right_item == list_tail(list));
 
-        if ((right_item == list->tail) ||
+        if ((right_item == list_tail(list)) ||
         	(right_item != (item*) get_unmarked_reference(old_it)))
             return NULL; //Item concurrently removed, nothing else to do
 
-		if((ITEM_cmp(left_item, new_it) == 0))
+		if(left_item != list_head(list) && (ITEM_cmp(left_item, new_it) == 0))
 			return NULL; //Someone else inserted the item before us
 						 //	it is up to the caller to choose if
 						 //	the operation should be repeated
 
 skip_search_1:
 
-        //Insert new item
+        //Insert new item, a failed CAS must not overwrite old_it
         new_it->next = right_item;
-        if (CAS(&(left_item->next), &old_it, new_it))
+        expected = old_it;
+        if (CAS(&(left_item->next), &expected, new_it))
             break;
 
+        COUNT_REPLACE_STAT(retries, 1);
     } while (true);
 
     *inserted = true;
@@ -480,11 +456,141 @@ skip_search_1:
 
     /* add removed item to be reclaimed */
     if(reclaim)
-        ebr_add_retired_item(right_item, CUSTOM_TYPE);
+        retire_item(right_item);
 
     return right_item;
 }
 
+static item* replace_posterior(List* list, const char* search_key, const size_t nkey, const uint32_t hv,
+    item *new_it, bool reclaim, bool *inserted) {
+
+    item *right_item, *left_item = NULL;
+	*inserted = false;
+
+    do {
+        right_item = search_last(list, search_key, nkey, hv, &left_item);
+
+        new_it->next = right_item;
+
+		if(left_item == NULL)
+			return NULL;
+
+        if (CAS(&(left_item->next), &right_item, new_it)) {
+			*inserted = true;
+			break;
+		}
+
+        COUNT_REPLACE_STAT(retries, 1);
+    } while (true); /*B3*/
+
+	bool found;
+	return del(list, search_key, nkey, hv, reclaim, &found);
+}
+
+//Not inserted if someone else inserted the key in between
+static item* replace_none(List* list, const char* search_key, const size_t nkey, const uint32_t hv,
+    item *new_it, bool reclaim, bool *inserted) {
+    bool found = false;
+    item *old_it = del(list, search_key, nkey, hv, reclaim, &found);
+
+    if (!(*inserted = insert(list, new_it)))
+        COUNT_REPLACE_STAT(retries, 1);
+    return old_it;
+}
+
+static const replace_algo replace_algos[] = {
+    {.name = "posterior", .replace = replace_posterior, .lookups_wait = false},
+    {.name = "mark", .replace = replace_mark, .lookups_wait = true},
+    {.name = "none", .replace = replace_none, .lookups_wait = false},
+};
+
+const replace_algo *nblist_replace_algo = &replace_algos[0];
+
+//NULL if there is none with that name
+const replace_algo *nblist_find_replace_algo(const char *name) {
+    for (size_t i = 0; i < sizeof(replace_algos) / sizeof(replace_algos[0]); i++) {
+        if (strcmp(replace_algos[i].name, name) == 0)
+            return &replace_algos[i];
+    }
+    return NULL;
+}
+
+//Replaces the item with the key by new_it, as nblist_replace_algo does
+item* replace(List* list, const char* search_key, const size_t nkey, const uint32_t hv,
+    item *new_it, bool reclaim, bool *inserted) {
+    return nblist_replace_algo->replace(list, search_key, nkey, hv, new_it, reclaim, inserted);
+}
+
+//Simple search, with slight difference of searching
+//	until current key is not greater than searched key
+//
+//	result: left and right item find last occurrence of a given key in a list
+item* search_last(List* list, const char* search_key, const size_t nkey, const uint32_t hv, item **left_item) {
+	//NULL because of warnings
+	item *left_item_next = NULL, *right_item;
+
+search_again:
+	do {
+        item *t = list_head(list);
+        item *t_next = list_head(list)->next; 
+        int marked_counter = 0;
+
+		//Wether the last item traversal had the same that we are looking for
+		bool last_item_equal = true;
+
+		/* 1: Find left_item and right_item */
+        do {
+            if (!is_marked_reference(t_next)) {
+                (* left_item) = t;
+                left_item_next = t_next;
+                marked_counter = 0;
+            } else {
+                marked_counter++;
+			}
+
+            t = (item *) get_unmarked_reference(t_next);
+            if (t == list_tail(list))
+				break;
+
+            t_next = t->next;
+
+        } while (is_marked_reference(t_next) ||
+            //Compare keys
+            ((last_item_equal = (HKEY_cmp(t, search_key, nkey, hv) <= 0)))); /*B1*/
+
+
+        right_item = t; 
+
+		/* 2: Check items are adjacent */
+        if (left_item_next == right_item) {
+
+            if ((right_item != list_tail(list)) && is_marked_reference(right_item->next)) {
+                goto search_again; /*G1*/
+			} else
+				return right_item; /*R1*/
+		}
+
+ 		/* 3: Remove one or more marked items */
+        if (CAS(&((*left_item)->next), &left_item_next, right_item)) { /*C1*/
+            COUNT_REPLACE_STAT(helps, marked_counter);
+            //Add one or more marked items to be reclaimed
+            item *e = (item*) get_unmarked_reference(left_item_next);
+            while(e != NULL && marked_counter > 0) {
+                retire_item(e);
+                assert(is_marked_reference(e->next));
+                e = (item*) get_unmarked_reference(e->next);
+                marked_counter--;
+            }
+
+            if ((right_item != list_tail(list)) && is_marked_reference(right_item->next))
+				goto search_again; /*G2*/
+            else
+		      	return right_item; /*R2*/
+		}
+
+    } while (true); /*B2*/
+}
+
 
 //Search by reference MUST delete logically removed items or it
 //	allows not (logically) deleted items to be inserted next to
@@ -508,18 +614,23 @@ search_again:
 
         //We retried because of replace marking
         replace_retries++;
+        COUNT_REPLACE_STAT(waits, 1);
+        if(replace_retries > REPLACE_SPINS)
+            sched_yield(); //It may not be running
 
         if(replace_retries >= MAX_REPLACE_RETRIES) {
             //Thread replacing has likely crashed
             //  try and finish part of the job, i.e., delete old item
-            del_by_ref(list, right_item, true);
-            return NULL; //Did not find item, abort
+            bool found;
+            COUNT_REPLACE_STAT(helps, 1);
+            del_by_ref(list, right_item, true, &found);
+            return SEARCH_ABORTED; //Did not find item, abort
         }
     }
 
 	do {
-        item *t = list->head;
-        item *t_next = list->head->next; 
+        item *t = list_head(list);
+        item *t_next = list_head(list)->next; 
         int marked_counter = 0;
 
 		/* 1: Find left_item and right_item */
@@ -533,7 +644,7 @@ search_again:
             }
 
             t = (item *) get_unmarked_reference(t_next);
-            if (t == list->tail)
+            if (t == list_tail(list))
 				break;
             t_next = t->next;
         } while (is_marked_reference(t_next) ||
@@ -545,7 +656,7 @@ search_again:
 		/* 2: Check items are adjacent */
         if (left_item_next == right_item) {
 
-            if ((right_item != list->tail) &&
+            if ((right_item != list_tail(list)) &&
                 (is_marked_reference(right_item->next) ||
                 (!ignore_replacement && is_marked_replacement_reference(right_item->next))))
                 goto search_again; /*G1*/
@@ -555,16 +666,17 @@ search_again:
 
  		/* 3: Remove one or more marked items */
         if (CAS(&((*left_item)->next), &left_item_next, right_item)) { /*C1*/
+            COUNT_REPLACE_STAT(helps, marked_counter);
             //Add one or more marked items to be reclaimed
             item *e = (item*) get_unmarked_reference(left_item_next);
             while(e != NULL && marked_counter > 0) {
-                ebr_add_retired_item(e, CUSTOM_TYPE);
+                retire_item(e);
                 assert(is_marked_reference(e->next));
                 e = (item*) get_unmarked_reference(e->next);
                 marked_counter--;
             }
 
-            if ((right_item != list->tail) &&
+            if ((right_item != list_tail(list)) &&
                 (is_marked_reference(right_item->next) ||
                 (!ignore_replacement && is_marked_replacement_reference(right_item->next))))
 				goto search_again; /*G2*/
@@ -577,184 +689,133 @@ search_again:
 
 
 
-//Same as del but search by ref
-item* del_by_ref(List *list, item *to_del, bool reclaim) {
+//Same as del but search by ref: deletes to_del itself, not whichever item
+//	has its key, so it never removes a newer version that replaced it.
+//	found is set once we marked it, even if a search has to unlink it
+item* del_by_ref(List *list, item *to_del, bool reclaim, bool *found) {
     item *right_item, *right_item_next, *left_item = NULL;
 
     do {
         right_item = search_by_ref(list, to_del, &left_item, true);
 
-        if (right_item == list->tail)
+        //Not there, or already marked by someone else
+        if (right_item != to_del)
             return NULL;
 
         right_item_next = right_item->next;
 
-        if (is_marked_reference(right_item_next) ||
+        if (!is_marked_reference(right_item_next) &&
             CAS(&(right_item->next), &right_item_next,
                 (item *) get_marked_reference(right_item_next)))
 				break;
 
     } while (true); /*B4*/
 
-    if (!CAS(&(left_item->next), &right_item, right_item_next)) {/*C4*/
-        //Possibly add item removal to search_by_ref, but it should
-        //  be ok to let normal search remove logically deleted items
+    *found = true;
+
+    if (!CAS(&(left_item->next), &right_item, (item*) get_unmarked_reference(right_item_next))) {/*C4*/
+        //Let a search unlink (and reclaim) it
+        search(list, ITEM_key(right_item), right_item->nkey, right_item->hv, &left_item, false);
         return NULL;
     }
 
     /* add removed item to be reclaimed */
     if(reclaim)
-        ebr_add_retired_item(right_item, CUSTOM_TYPE);
+        retire_item(right_item);
 
     return right_item;
 }
-//------------------------------------------MARK REPLACEMENT
-
-#else
-
 
-//POSTERIOR INSERTION REPLACEMENT---------------------------
-item* replace(List* list, const char* search_key, const size_t nkey, item *new_it,
-    bool reclaim, bool *inserted) {
-
-    item *right_item, *left_item = NULL;
-	*inserted = false;
+//Replaces old_it itself with new_it (same key), or fails if old_it is not in
+//	the list anymore, e.g. because someone else replaced or deleted it.
+//	A single CAS on old_it->next marks it as deleted and, as traversals
+//	skip marked items, makes new_it its successor in the list at once
+item* replace_if(List *list, item *old_it, item *new_it) {
+    item *left_item, *old_it_next;
 
     do {
-        right_item = search_last(list, search_key, nkey, &left_item);
-
-        new_it->next = right_item;
-
-		if(left_item == NULL || left_item->next == NULL)
-			return NULL;
-
-        if (CAS(&(left_item->next), &right_item, new_it)) {
-			*inserted = true;
-			break;
-		}
-
-    } while (true); /*B3*/
-
-	bool found;
-	return del(list, search_key, nkey, reclaim, &found);
-}
-
-//Simple search, with slight difference of searching
-//	until current key is not greater than searched key
-//
-//	result: left and right item find last occurrence of a given key in a list
-item* search_last(List* list, const char* search_key, const size_t nkey, item **left_item) {
-	//NULL because of warnings
-	item *left_item_next = NULL, *right_item;
-
-search_again:
-	do {
-        item *t = list->head;
-        item *t_next = list->head->next; 
-        int marked_counter = 0;
-
-		//Wether the last item traversal had the same that we are looking for
-		bool last_item_equal = true;
-
-		/* 1: Find left_item and right_item */
-        do {
-            if (!is_marked_reference(t_next)) {
-                (* left_item) = t;
-                left_item_next = t_next;
-                marked_counter = 0;
-            } else {
-                marked_counter++;
-			}
-
-            t = (item *) get_unmarked_reference(t_next);
-            if (t == list->tail)
-				break;
-
-            t_next = t->next;
-
-        } while (is_marked_reference(t_next) ||
-            //Compare keys
-            ((last_item_equal = (KEY_cmp(ITEM_key(t), search_key, t->nkey, nkey) <= 0)))); /*B1*/
-
-
-        right_item = t; 
+        old_it_next = old_it->next;
+        if (is_marked_reference(old_it_next) || is_marked_replacement_reference(old_it_next))
+            return NULL;
 
-		/* 2: Check items are adjacent */
-        if (left_item_next == right_item) {
+        new_it->next = old_it_next;
+    } while (!CAS(&(old_it->next), &old_it_next,
+        (item *) get_marked_reference(new_it)));
 
-            if ((right_item != list->tail) && is_marked_reference(right_item->next)) {
-                goto search_again; /*G1*/
-			} else
-				return right_item; /*R1*/
-		}
+    //Unlinking old_it is left to a search, which also reclaims it
+    search(list, ITEM_key(new_it), new_it->nkey, new_it->hv, &left_item, false);
 
- 		/* 3: Remove one or more marked items */
-        if (CAS(&((*left_item)->next), &left_item_next, right_item)) { /*C1*/
-            //Add one or more marked items to be reclaimed
-            item *e = (item*) get_unmarked_reference(left_item_next);
-            while(e != NULL && marked_counter > 0) {
-                ebr_add_retired_item(e, CUSTOM_TYPE);
-                assert(is_marked_reference(e->next));
-                e = (item*) get_unmarked_reference(e->next);
-                marked_counter--;
-            }
-
-            if ((right_item != list->tail) && is_marked_reference(right_item->next))
-				goto search_again; /*G2*/
-            else
-		      	return right_item; /*R2*/
-		}
-
-    } while (true); /*B2*/
+    return old_it;
 }
-//---------------------------POSTERIOR INSERTION REPLACEMENT
-#endif
 
 
 
 
 
-bool find(List *list, const char* search_key, const size_t nkey) {
+bool find(List *list, const char* search_key, const size_t nkey, const uint32_t hv) {
     item *right_item, *left_item = NULL;
 
-#ifdef MARK_REPLACEMENT
-    right_item = search(list, search_key, nkey, &left_item, false);
-#else
-    right_item = search(list, search_key, nkey, &left_item);
-#endif
+    right_item = search(list, search_key, nkey, hv, &left_item, false);
 
-    if ((right_item == NULL) || (right_item == list->tail) ||
-        (KEY_cmp(ITEM_key(right_item), search_key, right_item->nkey, nkey) != 0)) {
+    if ((right_item == SEARCH_ABORTED) || (right_item == list_tail(list)) ||
+        (HKEY_cmp(right_item, search_key, nkey, hv) != 0)) {
 		return false;
     } else {
 		return true;
     }
 }
 
-item* get(List *list, const char* search_key, const size_t nkey) {
+item* get(List *list, const char* search_key, const size_t nkey, const uint32_t hv) {
     item *right_item, *left_item = NULL;
-#ifdef MARK_REPLACEMENT
-    right_item = search(list, search_key, nkey, &left_item, false);
-#else
-    right_item = search(list, search_key, nkey, &left_item);
-#endif
-
-    if ((right_item == NULL) || (right_item == list->tail) ||
-        (KEY_cmp(ITEM_key(right_item), search_key, right_item->nkey, nkey) != 0)) {
+    right_item = search(list, search_key, nkey, hv, &left_item, false);
+
+    if ((right_item == SEARCH_ABORTED) || (right_item == list_tail(list)) ||
+        (HKEY_cmp(right_item, search_key, nkey, hv) != 0)) {
         return NULL;
     } else {
 		return right_item;
     }
 }
 
+//get() without helping: marked items are skipped instead of unlinked, so
+//  lookups never write to the list. Deletes unlink what they mark, or leave
+//  it to the next search, and a skipped item is not freed while we are not
+//  quiescent, so its next still leads to the rest of the list.
+//The number of items walked past is counted in walked
+item* get_readonly(List *list, const char* search_key, const size_t nkey, const uint32_t hv,
+        unsigned int *walked) {
+    *walked = 0;
+    //Items being replaced have to be waited for, get() does that
+    if (nblist_replace_algo->lookups_wait)
+        return get(list, search_key, nkey, hv);
+
+    item *t = (item*) get_unmarked_reference(__atomic_load_n(&list_head(list)->next, __ATOMIC_ACQUIRE));
+
+    while (t != list_tail(list)) {
+        item *t_next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+        (*walked)++;
+
+        if (!is_marked_reference(t_next)) {
+            int cmp = HKEY_cmp(t, search_key, nkey, hv);
+            if (cmp == 0)
+                return t;
+            if (cmp > 0)
+                return NULL; //Sorted, it is not further
+        }
+        t = (item*) get_unmarked_reference(t_next);
+    }
+
+    return NULL;
+}
+
 item* search_index(List* list, const int index, item **left_item, bool is_delete) {
 	//NULL because of warnings
 	item *left_item_next = NULL, *right_item;
 
 search_again:
 	do {
-        item *t = list->head;
-        item *t_next = list->head->next; 
+        item *t = list_head(list);
+        item *t_next = list_head(list)->next; 
         int marked_counter = 0;
         int i = -1; //-1 to account for head
 
@@ -769,8 +830,8 @@ search_again:
             }
 
             t = (item *) get_unmarked_reference(t_next);
-            if ((t == list->tail) || 
-                (is_delete && t->next == list->tail))
+            if ((t == list_tail(list)) || 
+                (is_delete && t->next == list_tail(list)))
 				break;
             t_next = t->next;
 
@@ -779,7 +840,7 @@ search_again:
         right_item = t; 
 		/* 2: Check items are adjacent */
         if (left_item_next == right_item) {
-            if ((right_item != list->tail) && is_marked_reference(right_item->next))
+            if ((right_item != list_tail(list)) && is_marked_reference(right_item->next))
                 goto search_again; /*G1*/
 			else
 				return right_item; /*R1*/
@@ -790,13 +851,13 @@ search_again:
             //Add one or more marked items to be reclaimed
             item *e = (item*) get_unmarked_reference(left_item_next);
             while(e != NULL && marked_counter > 0) {
-                ebr_add_retired_item(e, CUSTOM_TYPE);
+                retire_item(e);
                 assert(is_marked_reference(e->next));
                 e = (item*) get_unmarked_reference(e->next);
                 marked_counter--;
             }
 
-            if ((right_item != list->tail) && is_marked_reference(right_item->next))
+            if ((right_item != list_tail(list)) && is_marked_reference(right_item->next))
 				goto search_again; /*G2*/
             else
 		      	return right_item; /*R2*/
@@ -808,7 +869,7 @@ search_again:
 item* get_index(List *list, const int index) {
     item *right_item, *left_item = NULL;
     right_item = search_index(list, index, &left_item, false);
-    if ((right_item == list->tail))
+    if ((right_item == list_tail(list)))
 		return NULL;
     else
 		return right_item;
@@ -831,7 +892,7 @@ item* del_index(List* list, const int index) {
 
     do {
         right_item = search_index(list, index, &left_item, true);
-        if (right_item == list->tail)
+        if (right_item == list_tail(list))
             return NULL;
 
         right_item_next = right_item->next;
@@ -850,7 +911,7 @@ item* del_index(List* list, const int index) {
     }
 
     /* add removed item to be reclaimed */
-    ebr_add_retired_item(right_item, CUSTOM_TYPE);
+    retire_item(right_item);
     return right_item;
 }
 
@@ -7,24 +7,66 @@
 #include "memcached.h"
 #include "ebr.h"
 
-//#define MARK_REPLACEMENT					//Replacement algorithm with replacee marking
-#define POSTERIOR_INSERTION_REPLACEMENT		//Replacement algorithm with insertion after replacee
-//#define NO_REPLACEMENT 					//No replacement algorithm
-
-
 //Assumes that insert by index wont be used:
+//  Keys are compared by length first, so memcmp only ever sees keys of
+//  the same size and does not have to look for terminators like strncmp
 #define KEY_cmp(key1, key2, size1, size2) __extension__({int32_t diff = (size1 - size2); \
     diff != 0 ? diff : \
-    (strncmp(key1, key2, size1));})
+    (memcmp(key1, key2, size1));})
+
+//Lists are ordered by hash value (it->hv), then key: most comparisons are
+//  settled by the hash values without reading the keys
+#define HKEY_cmp(it, key, size, hash) __extension__({uint32_t _hv = (hash); \
+    (it)->hv != _hv ? ((it)->hv < _hv ? -1 : 1) : \
+    KEY_cmp(ITEM_key(it), key, (it)->nkey, size);})
 
-#define ITEM_cmp(it1, it2) KEY_cmp(ITEM_key(it1), ITEM_key(it2), it1->nkey, it2->nkey)
+//it->idx_flags: the item is, or was, a finger of a chain index, which has
+//  to be marked stale before the item is retired (assoc.c)
+#define IDX_SAMPLED 1
+void nblist_unindex(item *it);
+
+#define ITEM_cmp(it1, it2) HKEY_cmp(it1, ITEM_key(it2), (it2)->nkey, (it2)->hv)
 
 /* Declarations */
+//The head sentinel is embedded in the list itself: next is laid out
+//	like the next of an item, so a List can be used as the "left item"
+//	of its first node. The tail is implicit, the last item points to NULL.
+//A zero filled List is an empty list, so arrays of lists (buckets)
+//	can be calloc'ed without any further initialization.
 typedef struct List {
-	item *head;
-	item *tail;
+	struct _stritem *next;
 } List;
 
+#define list_head(l) ((item*) (l))
+#define list_tail(l) ((item*) NULL)
+
+//Replacement algorithms, picked at startup (-o replace_algo):
+//  posterior: inserts the new item after the replacee, then deletes it
+//  mark: marks the replacee as being replaced, inserts the new item before
+//      it, then deletes it. Lookups wait for marked items to be replaced
+//  none: deletes the replacee, then inserts the new item. The key is
+//      briefly missing
+typedef struct replace_algo {
+    const char *name;
+    //Returns the item replaced, NULL if none. inserted is set if new_it was
+    item* (*replace)(List* list, const char* search_key, const size_t nkey,
+        const uint32_t hv, item *new_it, bool reclaim, bool *inserted);
+    bool lookups_wait; //get_readonly() waits for items being replaced
+} replace_algo;
+
+extern const replace_algo *nblist_replace_algo;
+const replace_algo *nblist_find_replace_algo(const char *name);
+
+//How replacements went, counted per thread (tid)
+typedef struct replace_stats {
+    uint64_t retries; //CASes of replace() that failed and were retried
+    uint64_t waits;   //Searches restarted for an item being replaced
+    uint64_t helps;   //Items deleted by others that searches unlinked
+} replace_stats;
+
+void nblist_init_stats(const int nthreads);
+void nblist_replace_stats(replace_stats *totals);
+
 
 void free_list(List* l);
 void print_list(List * list);
@@ -36,13 +78,17 @@ int cleanup(List* list);
 int empty_list(List* list);
 bool is_empty(List *list);
 int __mark_all_nodes(List* list);
+bool mark_node(item *it);
 bool insert(List *list, item *it);
-item* del(List* list, const char* search_key, const size_t nkey, bool reclaim, bool *found);
-item* replace(List* list, const char* search_key, const size_t nkey, item *new_it, bool reclaim, bool *inserted);
+item* del(List* list, const char* search_key, const size_t nkey, const uint32_t hv, bool reclaim, bool *found);
+item* replace(List* list, const char* search_key, const size_t nkey, const uint32_t hv, item *new_it, bool reclaim, bool *inserted);
 item* search_by_ref(List* list, item *search_item, item **left_item, bool ignore_replacement);
-item* del_by_ref(List *list, item *to_del, bool reclaim);
-bool find(List *list, const char* search_key, const size_t nkey);
-item* get(List *list, const char* search_key, const size_t nkey);
+item* del_by_ref(List *list, item *to_del, bool reclaim, bool *found);
+item* replace_if(List *list, item *old_it, item *new_it);
+bool find(List *list, const char* search_key, const size_t nkey, const uint32_t hv);
+item* get(List *list, const char* search_key, const size_t nkey, const uint32_t hv);
+item* get_readonly(List *list, const char* search_key, const size_t nkey, const uint32_t hv,
+        unsigned int *walked);
 item* search_index(List* list, const int index, item **left_item, bool is_delete);
 item* get_index(List *list, const int index);
 bool insert_index(List *list, item* it, int index);
@@ -53,22 +99,15 @@ item* del_head(List* list);
 item* del_tail(List* list);
 
 
-#ifdef MARK_REPLACEMENT
-item* search(List* list, const char* search_key, const size_t nkey, item **left_item, bool ignore_replacement);
-#else //POSTERIOR INSERTION REPLACEMENT
-item* search(List* list, const char* search_key, const size_t nkey, item **left_item);
-item* search_last(List* list, const char* search_key, const size_t nkey, item **left_item);
-#endif
-
-
-typedef struct {
-    struct _stritem *next;
-} fake_item;
+item* search(List* list, const char* search_key, const size_t nkey, const uint32_t hv, item **left_item, bool ignore_replacement);
+item* search_last(List* list, const char* search_key, const size_t nkey, const uint32_t hv, item **left_item);
 
 
 /*---------------------------DECLARATION---------------------------*/
 /* Reclamation related variables */
 extern __thread reclamation* recl;
+extern __thread bool ebr_in_command;
+extern __thread int ebr_batch_commands;
 
 void static inline ebr_add_retired_item(item* item, int reclaim_type) {
 	add_retired_item(recl, item, reclaim_type);
@@ -76,6 +115,39 @@ void static inline ebr_add_retired_item(item* item, int reclaim_type) {
 void static inline ebr_announce_epoch() {announce_epoch(recl);}
 void static inline ebr_enter_quiescent() {enter_quiescent(recl);}
 void static inline ebr_leave_quiescent() {leave_quiescent(recl);}
+bool static inline ebr_is_quiescent() {return is_quiescent(recl);}
+bool static inline ebr_has_retired() {return has_retired(recl);}
+uint64_t static inline ebr_count_retired() {return count_retired(recl);}
+/* Workers leave quiescence at the first command of an event loop iteration
+ * and stay out of it until the iteration ends (ebr_end_batch()), instead of
+ * announcing around every command of a pipeline. Between commands they
+ * hold no item references, so they announce there every reqs_per_event
+ * commands, not to hold the epoch back for a whole iteration */
+void static inline ebr_begin_command() {
+    ebr_in_command = true;
+    if (is_quiescent(recl))
+        leave_quiescent(recl);
+}
+void static inline ebr_end_command() {
+    ebr_in_command = false;
+    if (++ebr_batch_commands >= settings.reqs_per_event) {
+        ebr_batch_commands = 0;
+        enter_quiescent(recl);
+    }
+}
+//Before the worker waits for events
+void static inline ebr_end_batch() {
+    ebr_batch_commands = 0;
+    if (!is_quiescent(recl))
+        enter_quiescent(recl);
+}
+//Advances the epoch until what this thread retired is reclaimed (the limbo
+//  bag of epoch e is reclaimed at e + 2), unless another thread lags behind.
+//  Only while holding no item references
+void static inline ebr_reclaim_retired() {
+    for (int i = 0; i < 3; i++)
+        announce_epoch(recl);
+}
 
 
 //"Generic" key type (equivalent to void)
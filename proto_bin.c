@@ -12,6 +12,8 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "nblist.h"
+
 /** binprot handlers **/
 static void process_bin_flush(conn *c, char *extbuf);
 static void process_bin_append_prepend(conn *c);
@@ -475,6 +477,7 @@ static void process_bin_get_or_touch(conn *c, char *extbuf) {
         fputc('\n', stderr);
     }
 
+    ebr_begin_command(); //Starting to look into data-structure
     if (should_touch) {
         protocol_binary_request_touch *t = (void *)extbuf;
         time_t exptime = ntohl(t->message.body.expiration);
@@ -485,9 +488,15 @@ static void process_bin_get_or_touch(conn *c, char *extbuf) {
     }
 
     if (it) {
+        /* numeric values are rendered after the response header */
+        char *num = c->resp->wbuf + sizeof(*rsp);
+        int nbytes = it->nbytes;
+        if (it->it_flags & ITEM_NUMERIC) {
+            nbytes = item_numeric_render(it, num);
+        }
         /* the length has two unnecessary bytes ("\r\n") */
         uint16_t keylen = 0;
-        uint32_t bodylen = sizeof(rsp->message.body) + (it->nbytes - 2);
+        uint32_t bodylen = sizeof(rsp->message.body) + (nbytes - 2);
 
         pthread_mutex_lock(&c->thread->stats.mutex);
         if (should_touch) {
@@ -508,7 +517,7 @@ static void process_bin_get_or_touch(conn *c, char *extbuf) {
         }
 
         if (c->cmd == PROTOCOL_BINARY_CMD_TOUCH) {
-            bodylen -= it->nbytes - 2;
+            bodylen -= nbytes - 2;
         } else if (should_return_key) {
             bodylen += nkey;
             keylen = nkey;
@@ -528,7 +537,9 @@ static void process_bin_get_or_touch(conn *c, char *extbuf) {
 
         if (should_return_value) {
             /* Add the data minus the CRLF */
-            if ((it->it_flags & ITEM_CHUNKED) == 0) {
+            if (it->it_flags & ITEM_NUMERIC) {
+                resp_add_iov(c->resp, num, nbytes - 2);
+            } else if ((it->it_flags & ITEM_CHUNKED) == 0) {
                 resp_add_iov(c->resp, ITEM_data(it), it->nbytes - 2);
             } else {
                 resp_add_chunked_iov(c->resp, it, it->nbytes - 2);
@@ -543,10 +554,10 @@ static void process_bin_get_or_touch(conn *c, char *extbuf) {
                 // Only have extstore clean if header and returning value.
                 c->resp->item = NULL;
             } else {
-                c->resp->item = it;
+                resp_hold_item(c->resp, it);
             }
 #else
-            c->resp->item = it;
+            resp_hold_item(c->resp, it);
 #endif
         } else {
             item_remove(it);
@@ -554,6 +565,7 @@ static void process_bin_get_or_touch(conn *c, char *extbuf) {
     } else {
         failed = true;
     }
+    ebr_end_command();
 
     if (failed) {
         pthread_mutex_lock(&c->thread->stats.mutex);
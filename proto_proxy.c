@@ -574,6 +574,7 @@ int proxy_run_coroutine(lua_State *Lc, mc_resp *resp, io_pending_proxy_t *p, con
                 resp->request_addr = tresp->request_addr;
                 resp->request_addr_size = tresp->request_addr_size;
                 resp->item = tresp->item; // will be populated if not extstore fetch
+                tresp->item = NULL; // its hold moves to resp
                 resp->skip = tresp->skip;
 
                 // we let the mcp_resp gc handler free up tresp and any
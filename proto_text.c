@@ -172,8 +172,7 @@ void complete_nread_ascii(conn *c) {
       uint64_t cas = 0;
       c->thread->cur_sfd = c->sfd; // cuddle sfd for logging.
 
-      //ebr_announce_epoch();
-      ebr_leave_quiescent();
+      ebr_begin_command();
       ret = store_item(it, comm, c->thread, &cas, c->set_stale);
 
 #ifdef ENABLE_DTRACE
@@ -233,7 +232,7 @@ void complete_nread_ascii(conn *c) {
     c->mset_res = false;
     item_remove(c->item);       /* release the c->item reference */
     c->item = 0;
-    ebr_enter_quiescent();
+    ebr_end_command();
 }
 
 #define COMMAND_TOKEN 0
@@ -571,20 +570,18 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
         exptime = realtime(EXPTIME_TO_POSITIVE_TIME(exptime_int));
     }
 
-    //ebr_announce_epoch(); //Starting to look into data-structure
-    ebr_leave_quiescent();
+    ebr_begin_command(); //Starting to look into data-structure
     do {
-        while(key_token->length != 0) {
-            bool overflow; // not used here.
-            key = key_token->value;
-            nkey = key_token->length;
-
-            if (nkey > KEY_MAX_LENGTH) {
-                fail_length = true;
-                goto stop;
-            }
-
+        //Every key of this group of tokens is looked up before any response
+        //  is built, so that their cache misses overlap
+        const char *keys[MAX_TOKENS];
+        size_t nkeys[MAX_TOKENS];
+        item *its[MAX_TOKENS];
+        int nbatch = 0, k = 0;
 
+        for (token_t *t = key_token; t->length != 0 && t->length <= KEY_MAX_LENGTH; t++) {
+            keys[nbatch] = t->value;
+            nkeys[nbatch] = t->length;
 
 #ifdef FORCE_HITRATIO
 			int sample = (int) fmod(num_get_requests++, force_hitratio_helper);
@@ -595,14 +592,34 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
 
 			if(force_miss) {
 				//printf("Miss %lf!\n", num_get_requests);
-				key = "notfound";
-				nkey = 8;
+				keys[nbatch] = "notfound";
+				nkeys[nbatch] = 8;
 			}
 #endif
 
+            nbatch++;
+        }
+        if (!should_touch && nbatch > 0) {
+            limited_get_batch(keys, nkeys, nbatch, c->thread, DO_UPDATE, its);
+        }
+
+        while(key_token->length != 0) {
+            bool overflow; // not used here.
 
+            if (k == nbatch) {
+                //Only keys up to the first that is too long were looked up
+                fail_length = true;
+                goto stop;
+            }
+            key = (char*) keys[k];
+            nkey = nkeys[k];
 
-            it = limited_get(key, nkey, c->thread, exptime, should_touch, DO_UPDATE, &overflow);
+            if (should_touch) {
+                it = limited_get(key, nkey, c->thread, exptime, should_touch, DO_UPDATE, &overflow);
+            } else {
+                it = its[k];
+            }
+            k++;
             if (settings.detail_enabled) {
                 stats_prefix_record_get(key, nkey, NULL != it);
             }
@@ -618,19 +635,27 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                 {
                   MEMCACHED_COMMAND_GET(c->sfd, ITEM_key(it), it->nkey,
                                         it->nbytes, ITEM_get_cas(it));
-                  int nbytes = it->nbytes;;
-                  nbytes = it->nbytes;
+                  char num[ITEM_NUMERIC_LEN];
+                  int nbytes = it->nbytes;
+                  if (it->it_flags & ITEM_NUMERIC) {
+                      nbytes = item_numeric_render(it, num);
+                  }
                   char *p = resp->wbuf;
                   memcpy(p, "VALUE ", 6);
                   p += 6;
                   memcpy(p, ITEM_key(it), it->nkey);
                   p += it->nkey;
                   p += make_ascii_get_suffix(p, it, return_cas, nbytes);
-                  resp_add_iov(resp, resp->wbuf, p - resp->wbuf);
 
-                  if ((it->it_flags & ITEM_CHUNKED) == 0) {
+                  if (it->it_flags & ITEM_NUMERIC) {
+                      /* The value goes out with the header */
+                      memcpy(p, num, nbytes);
+                      resp_add_iov(resp, resp->wbuf, (p - resp->wbuf) + nbytes);
+                  } else if ((it->it_flags & ITEM_CHUNKED) == 0) {
+                      resp_add_iov(resp, resp->wbuf, p - resp->wbuf);
                       resp_add_iov(resp, ITEM_data(it), it->nbytes);
                   } else {
+                      resp_add_iov(resp, resp->wbuf, p - resp->wbuf);
                       resp_add_chunked_iov(resp, it, it->nbytes);
                   }
                 }
@@ -644,7 +669,6 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                     fprintf(stderr, "\n");
                 }
 
-                /* item_get() has incremented it->refcount for us */
                 pthread_mutex_lock(&c->thread->stats.mutex);
                 if (should_touch) {
                     c->thread->stats.touch_cmds++;
@@ -654,12 +678,9 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                     c->thread->stats.get_cmds++;
                 }
                 pthread_mutex_unlock(&c->thread->stats.mutex);
-                //This is useless if the item is in the data structure
-                //It was previously used to release the reference or free the item
-                //  if it was not in the data structure
-                //This means it is safe to enter a quiescent state (no references to items held)
-                //  after this because the references won't be used
-                resp->item = it;
+                //The value is sent from the item itself, its memory stays
+                //  held until it is
+                resp_hold_item(resp, it);
 
             } else {
                 pthread_mutex_lock(&c->thread->stats.mutex);
@@ -697,7 +718,7 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
         }
     } while(key_token->value != NULL);
 stop:
-    ebr_enter_quiescent(); //Starting to look into data-structure
+    ebr_end_command();
 
 
     if (settings.verbose > 1)
@@ -1108,6 +1129,7 @@ static void process_mget_command(conn *c, token_t *tokens, const size_t ntokens)
     // TODO: need to indicate if the item was overflowed or not?
     // I think we do, since an overflow shouldn't trigger an alloc/replace.
     bool overflow = false;
+    ebr_begin_command(); //Starting to look into data-structure
     if (!of.locked) {
         it = limited_get(key, nkey, c->thread, 0, false, !of.no_update, &overflow);
     } else {
@@ -1120,6 +1142,7 @@ static void process_mget_command(conn *c, token_t *tokens, const size_t ntokens)
     // We definitely don't want to re-autovivify by accident.
     if (overflow) {
         assert(it == NULL);
+        ebr_end_command();
         out_errstring(c, "SERVER_ERROR refcount overflow during fetch");
         return;
     }
@@ -1144,9 +1167,15 @@ static void process_mget_command(conn *c, token_t *tokens, const size_t ntokens)
     // don't have to check result of add_iov() since the iov size defaults are
     // enough.
     if (it) {
+        char num[ITEM_NUMERIC_LEN];
+        int nbytes = it->nbytes;
+        if (it->it_flags & ITEM_NUMERIC) {
+            nbytes = item_numeric_render(it, num);
+        }
+
         if (of.value) {
             memcpy(p, "VA ", 3);
-            p = itoa_u32(it->nbytes-2, p+3);
+            p = itoa_u32(nbytes-2, p+3);
         } else {
             memcpy(p, "HD", 2);
             p += 2;
@@ -1176,7 +1205,7 @@ static void process_mget_command(conn *c, token_t *tokens, const size_t ntokens)
                     break;
                 case 's':
                     META_CHAR(p, 's');
-                    p = itoa_u32(it->nbytes-2, p);
+                    p = itoa_u32(nbytes-2, p);
                     break;
                 case 't':
                     // TTL remaining as of this request.
@@ -1256,10 +1285,15 @@ static void process_mget_command(conn *c, token_t *tokens, const size_t ntokens)
         *(p+1) = '\n';
         *(p+2) = '\0';
         p += 2;
+        if (of.value && (it->it_flags & ITEM_NUMERIC)) {
+            // the value goes out with the buffer.
+            memcpy(p, num, nbytes);
+            p += nbytes;
+        }
         // finally, chain in the buffer.
         resp_add_iov(resp, resp->wbuf, p - resp->wbuf);
 
-        if (of.value) {
+        if (of.value && (it->it_flags & ITEM_NUMERIC) == 0) {
             if ((it->it_flags & ITEM_CHUNKED) == 0) {
                 resp_add_iov(resp, ITEM_data(it), it->nbytes);
             } else {
@@ -1268,7 +1302,7 @@ static void process_mget_command(conn *c, token_t *tokens, const size_t ntokens)
         }
 
         // need to hold the ref at least because of the key above.
-        resp->item = it;
+        resp_hold_item(resp, it);
     } else {
         failed = true;
     }
@@ -1334,11 +1368,13 @@ static void process_mget_command(conn *c, token_t *tokens, const size_t ntokens)
         resp_add_iov(resp, resp->wbuf, resp->wbytes);
         conn_set_state(c, conn_new_cmd);
     }
+    ebr_end_command();
     return;
 error:
     if (it) {
         //do_item_remove(it);
     }
+    ebr_end_command();
     out_errstring(c, errstr);
 }
 
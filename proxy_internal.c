@@ -120,19 +120,27 @@ static void process_get_cmd(LIBEVENT_THREAD *t, mcp_parser_t *pr, mc_resp *resp,
 
     item *it = limited_get(key, nkey, t, exptime, should_touch, DO_UPDATE, &overflow);
     if (it) {
-      int nbytes = it->nbytes;;
-      nbytes = it->nbytes;
+      char num[ITEM_NUMERIC_LEN];
+      int nbytes = it->nbytes;
+      if (it->it_flags & ITEM_NUMERIC) {
+          nbytes = item_numeric_render(it, num);
+      }
       char *p = resp->wbuf;
       memcpy(p, "VALUE ", 6);
       p += 6;
       memcpy(p, ITEM_key(it), it->nkey);
       p += it->nkey;
       p += make_ascii_get_suffix(p, it, return_cas, nbytes);
-      resp_add_iov(resp, resp->wbuf, p - resp->wbuf);
 
-      if ((it->it_flags & ITEM_CHUNKED) == 0) {
+      if (it->it_flags & ITEM_NUMERIC) {
+          /* The value goes out with the header */
+          memcpy(p, num, nbytes);
+          resp_add_iov(resp, resp->wbuf, (p - resp->wbuf) + nbytes);
+      } else if ((it->it_flags & ITEM_CHUNKED) == 0) {
+          resp_add_iov(resp, resp->wbuf, p - resp->wbuf);
           resp_add_iov(resp, ITEM_data(it), it->nbytes);
       } else {
+          resp_add_iov(resp, resp->wbuf, p - resp->wbuf);
           resp_add_chunked_iov(resp, it, it->nbytes);
       }
 
@@ -146,7 +154,7 @@ static void process_get_cmd(LIBEVENT_THREAD *t, mcp_parser_t *pr, mc_resp *resp,
             t->stats.get_cmds++;
         }
         pthread_mutex_unlock(&t->stats.mutex);
-        resp->item = it;
+        resp_hold_item(resp, it);
     } else {
         pthread_mutex_lock(&t->stats.mutex);
         if (should_touch) {
@@ -660,9 +668,15 @@ static void process_mget_cmd(LIBEVENT_THREAD *t, mcp_parser_t *pr, mc_resp *resp
     // don't have to check result of add_iov() since the iov size defaults are
     // enough.
     if (it) {
+        char num[ITEM_NUMERIC_LEN];
+        int nbytes = it->nbytes;
+        if (it->it_flags & ITEM_NUMERIC) {
+            nbytes = item_numeric_render(it, num);
+        }
+
         if (of.value) {
             memcpy(p, "VA ", 3);
-            p = itoa_u32(it->nbytes-2, p+3);
+            p = itoa_u32(nbytes-2, p+3);
         } else {
             memcpy(p, "HD", 2);
             p += 2;
@@ -692,7 +706,7 @@ static void process_mget_cmd(LIBEVENT_THREAD *t, mcp_parser_t *pr, mc_resp *resp
                     break;
                 case 's':
                     META_CHAR(p, 's');
-                    p = itoa_u32(it->nbytes-2, p);
+                    p = itoa_u32(nbytes-2, p);
                     break;
                 case 't':
                     // TTL remaining as of this request.
@@ -773,10 +787,15 @@ static void process_mget_cmd(LIBEVENT_THREAD *t, mcp_parser_t *pr, mc_resp *resp
         *(p+1) = '\n';
         *(p+2) = '\0';
         p += 2;
+        if (of.value && (it->it_flags & ITEM_NUMERIC)) {
+            // the value goes out with the buffer.
+            memcpy(p, num, nbytes);
+            p += nbytes;
+        }
         // finally, chain in the buffer.
         resp_add_iov(resp, resp->wbuf, p - resp->wbuf);
 
-        if (of.value) {
+        if (of.value && (it->it_flags & ITEM_NUMERIC) == 0) {
             if ((it->it_flags & ITEM_CHUNKED) == 0) {
                 resp_add_iov(resp, ITEM_data(it), it->nbytes);
             } else {
@@ -785,7 +804,7 @@ static void process_mget_cmd(LIBEVENT_THREAD *t, mcp_parser_t *pr, mc_resp *resp
         }
 
         // need to hold the ref at least because of the key above.
-        resp->item = it;
+        resp_hold_item(resp, it);
     } else {
         failed = true;
     }
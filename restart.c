@@ -381,15 +381,12 @@ unsigned int restart_fixup(void *orig_addr) {
         }
 
         if (it->it_flags & ITEM_LINKED) {
-            // fixup next/prev links while on LRU.
+            // fixup next link while in the hash table. prev shares its
+            // space with the item's hash data there, it is not a pointer.
             if (it->next) {
                 it->next = (item *)((mc_ptr_t)it->next - (mc_ptr_t)orig_addr);
                 it->next = (item *)((mc_ptr_t)it->next + (mc_ptr_t)mmap_base);
             }
-            if (it->prev) {
-                it->prev = (item *)((mc_ptr_t)it->prev - (mc_ptr_t)orig_addr);
-                it->prev = (item *)((mc_ptr_t)it->prev + (mc_ptr_t)mmap_base);
-            }
 
             //fprintf(stderr, "item was linked\n");
             //do_item_link_fixup(it);
@@ -21,6 +21,7 @@
 #include <signal.h>
 #include <assert.h>
 #include <pthread.h>
+#include "nblist.h"
 
 //#define DEBUG_SLAB_MOVER
 /* powers-of-N allocation structures */
@@ -667,6 +668,16 @@ void slabs_free(void *ptr, size_t size, unsigned int id) {
     pthread_mutex_unlock(&slabs_lock);
 }
 
+void slabs_free_items(item **its, const int n) {
+    if (n == 0)
+        return;
+    pthread_mutex_lock(&slabs_lock);
+    for (int i = 0; i < n; i++) {
+        do_slabs_free(its[i], ITEM_ntotal(its[i]), ITEM_clsid(its[i]));
+    }
+    pthread_mutex_unlock(&slabs_lock);
+}
+
 void slabs_stats(ADD_STAT add_stats, void *c) {
     pthread_mutex_lock(&slabs_lock);
     do_slabs_stats(add_stats, c);
@@ -898,10 +909,12 @@ static int slab_rebalance_move(void) {
                  * ITEM_SLABBED, but it's had ITEM_LINKED, it must be active
                  * and have the key written to it already.
                  */
-                hv = hash(ITEM_key(it), it->nkey);
+                hv = it->hv;
                 bool is_linked = (it->it_flags & ITEM_LINKED);
+                /* Idle items have no reference, only responses sending
+                 * them hold one (resp_hold_item()) */
                 refcount = refcount_incr(it);
-                if (refcount == 2) { /* item is linked but not busy */
+                if (refcount == 1) { /* item is linked but not busy */
                     /* Double check ITEM_LINKED flag here, since we're
                      * past a memory barrier from the mutex. */
                     if (is_linked) {
@@ -912,15 +925,17 @@ static int slab_rebalance_move(void) {
                          * yet. Let it bleed off on its own and try again later */
                         status = MOVE_BUSY;
                     }
-                } else if (refcount > 2 && is_linked) {
+                } else if (refcount > 1 && is_linked) {
                     // TODO: Mark items for delete/rescue and process
                     // outside of the main loop.
                     if (slab_rebal.busy_loops > SLAB_MOVE_MAX_LOOPS) {
                         slab_rebal.busy_deletes++;
-                        // Only safe to hold slabs lock because refcount
-                        // can't drop to 0 until we release item lock.
+                        // Safe to drop slabs lock because the item can't
+                        // be reclaimed while we hold a refcount.
                         pthread_mutex_unlock(&slabs_lock);
+                        ebr_leave_quiescent();
                         do_item_unlink(it, hv);
+                        ebr_enter_quiescent();
                         pthread_mutex_lock(&slabs_lock);
                     }
                     status = MOVE_BUSY;
@@ -949,31 +964,23 @@ static int slab_rebalance_move(void) {
             case MOVE_FROM_LRU:
                 /* Lock order is LRU locks -> slabs_lock. unlink uses LRU lock.
                  * We only need to hold the slabs_lock while initially looking
-                 * at an item, and at this point we have an exclusive refcount
-                 * (2) + the item is locked. Drop slabs lock, drop item to
-                 * refcount 1 (just our own, then fall through and wipe it
+                 * at an item, and at this point we hold the only refcount
+                 * (1, our own: no response sends from it), so it can not be
+                 * reclaimed under us. Drop slabs lock, then move or unlink it
                  */
                 /* Check if expired or flushed */
                 ntotal = ITEM_ntotal(it);
 
-                /* REQUIRES slabs_lock: CHECK FOR cls->sl_curr > 0 */
-                if (ch == NULL && (it->it_flags & ITEM_CHUNKED)) {
-                    /* Chunked should be identical to non-chunked, except we need
-                     * to swap out ntotal for the head-chunk-total. */
-                    ntotal = s_cls->size;
-                }
                 if ((it->exptime != 0 && it->exptime < current_time)
                     || item_is_flushed(it)) {
                     /* Expired, don't save. */
                     save_item = 0;
-                } else if (ch == NULL &&
-                        (new_it = slab_rebalance_alloc(ntotal, slab_rebal.s_clsid)) == NULL) {
-                    /* Not a chunk of an item, and nomem. */
+                } else if (ch != NULL || (it->it_flags & ITEM_CHUNKED)) {
+                    /* The old item's chunks are freed with it once it is
+                     * reclaimed, so chunked items are not copied */
                     save_item = 0;
-                    slab_rebal.evictions_nomem++;
-                } else if (ch != NULL &&
-                        (new_it = slab_rebalance_alloc(s_cls->size, slab_rebal.s_clsid)) == NULL) {
-                    /* Is a chunk of an item, and nomem. */
+                } else if ((new_it = slab_rebalance_alloc(ntotal, slab_rebal.s_clsid)) == NULL) {
+                    /* nomem. */
                     save_item = 0;
                     slab_rebal.evictions_nomem++;
                 } else {
@@ -981,73 +988,33 @@ static int slab_rebalance_move(void) {
                     save_item = 1;
                 }
                 pthread_mutex_unlock(&slabs_lock);
+                /* Readers find items without any lock, so one taken out of
+                 * the hash table is retired like any other: its chunk only
+                 * comes back here as a free one (MOVE_FROM_SLAB) once no
+                 * reader can still see it. Until then it counts as busy */
+                ebr_leave_quiescent();
                 if (save_item) {
-                    if (ch == NULL) {
-                        assert((new_it->it_flags & ITEM_CHUNKED) == 0);
-                        /* if free memory, memcpy. clear prev/next/h_bucket */
-                        memcpy(new_it, it, ntotal);
-                        new_it->prev = 0;
-                        new_it->next = 0;
-                        /* These are definitely required. else fails assert */
-                        new_it->it_flags &= ~ITEM_LINKED;
-                        new_it->refcount = 0;
-                        do_item_replace(it, new_it, hv);
-                        /* Need to walk the chunks and repoint head  */
-                        if (new_it->it_flags & ITEM_CHUNKED) {
-                            item_chunk *fch = (item_chunk *) ITEM_schunk(new_it);
-                            fch->next->prev = fch;
-                            while (fch) {
-                                fch->head = new_it;
-                                fch = fch->next;
-                            }
-                        }
-                        it->refcount = 0;
-                        it->it_flags = ITEM_SLABBED|ITEM_FETCHED;
-#ifdef DEBUG_SLAB_MOVER
-                        memcpy(ITEM_key(it), "deadbeef", 8);
-#endif
+                    /* if free memory, memcpy. clear next. prev shares its
+                     * space with hv, which do_item_replace() needs. */
+                    memcpy(new_it, it, ntotal);
+                    new_it->next = 0;
+                    /* These are definitely required. else fails assert */
+                    new_it->it_flags &= ~ITEM_LINKED;
+                    new_it->refcount = 0;
+                    /* Replaced or deleted meanwhile: nothing left to save */
+                    if (do_item_replace_if(it, new_it, hv)) {
                         slab_rebal.rescues++;
                     } else {
-                        item_chunk *nch = (item_chunk *) new_it;
-                        /* Chunks always have head chunk (the main it) */
-                        ch->prev->next = nch;
-                        if (ch->next)
-                            ch->next->prev = nch;
-                        memcpy(nch, ch, ch->used + sizeof(item_chunk));
-                        ch->refcount = 0;
-                        ch->it_flags = ITEM_SLABBED|ITEM_FETCHED;
-                        slab_rebal.chunk_rescues++;
-#ifdef DEBUG_SLAB_MOVER
-                        memcpy(ITEM_key((item *)ch), "deadbeef", 8);
-#endif
-                        refcount_decr(it);
+                        slabs_free(new_it, ntotal, slab_rebal.s_clsid);
                     }
-                    slab_rebal.completed[offset] = 1;
                 } else {
-                    /* unlink and mark as done if it's not
-                     * a chunked item as they require more book-keeping) */
-                    if (!ch && (it->it_flags & ITEM_CHUNKED) == 0) {
-                        do_item_unlink(it, hv);
-                        it->it_flags = ITEM_SLABBED|ITEM_FETCHED;
-                        it->refcount = 0;
-#ifdef DEBUG_SLAB_MOVER
-                        memcpy(ITEM_key(it), "deadbeef", 8);
-#endif
-                        slab_rebal.completed[offset] = 1;
-                    } else {
-                        ntotal = ITEM_ntotal(it);
-                        do_item_unlink(it, hv);
-                        slabs_free(it, ntotal, slab_rebal.s_clsid);
-                        /* Swing around again later to remove it from the freelist. */
-                        slab_rebal.busy_items++;
-                        was_busy++;
-                    }
-
+                    do_item_unlink(it, hv);
                 }
+                refcount_decr(it);
+                ebr_enter_quiescent();
+                slab_rebal.busy_items++;
+                was_busy++;
                 pthread_mutex_lock(&slabs_lock);
-                /* Always remove the ntotal, as we added it in during
-                 * do_slabs_alloc() when copying the item.
-                 */
                 break;
             case MOVE_FROM_SLAB:
                 slab_rebal.completed[offset] = 1;
@@ -1184,10 +1151,18 @@ static void slab_rebalance_finish(void) {
 /* Slab mover thread.
  * Sits waiting for a condition to jump off and shovel some memory about
  */
+#define SLAB_MOVER_BAG_SIZE 100
+
+extern ebr *r; /* thread.c */
+
 static void *slab_rebalance_thread(void *arg) {
     int was_busy = 0;
     int backoff_timer = 1;
     int backoff_max = 1000;
+    /* Items it takes out of the hash table are retired like the workers' */
+    tid = settings.num_threads + 2;
+    recl = init_reclamation(r, tid, SLAB_MOVER_BAG_SIZE);
+    ebr_enter_quiescent();
     /* So we first pass into cond_wait with the mutex held */
     mutex_lock(&slabs_rebalance_lock);
 
@@ -1207,6 +1182,12 @@ static void *slab_rebalance_thread(void *arg) {
         if (slab_rebal.done) {
             slab_rebalance_finish();
         } else if (was_busy) {
+            /* What it moved or unlinked comes back to the page once it is
+             * reclaimed */
+            if (ebr_has_retired()) {
+                ebr_reclaim_retired();
+                ebr_enter_quiescent();
+            }
             /* Stuck waiting for some items to unlock, so slow down a bit
              * to give them a chance to free up */
             usleep(backoff_timer);
@@ -27,6 +27,8 @@ void *slabs_alloc(const size_t size, unsigned int id, unsigned int flags);
 
 /** Free previously allocated object */
 void slabs_free(void *ptr, size_t size, unsigned int id);
+/** Free n items, in a single lock acquisition */
+void slabs_free_items(item **its, const int n);
 
 /** Adjust global memory limit up or down */
 bool slabs_adjust_mem_limit(size_t new_mem_limit);
@@ -0,0 +1,64 @@
+#!/usr/bin/env perl
+
+use strict;
+use Test::More tests => 28;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# New keys of a slab class that evicts are only stored
+# if they were looked up more often than what the class evicts.
+my $server = new_memcached('-m 8 -o admission_filter');
+my $sock = $server->sock;
+
+# Nothing evicts yet, every key is stored.
+print $sock "set foo 0 0 1\r\n1\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+mem_get_is($sock, "foo", "1");
+print $sock "incr foo 5\r\n";
+is(scalar <$sock>, "6\r\n", "incr foo");
+print $sock "delete foo\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted foo");
+mem_get_is($sock, "foo", undef);
+
+my $stats = mem_stats($sock);
+is($stats->{admission_admitted}, 0, "no key judged before evictions");
+is($stats->{admission_rejected}, 0, "no key dropped before evictions");
+
+# Keys never looked up, more than the memory holds.
+my $value = "C" x 8000;
+my %res = ();
+my $first_dropped;
+for my $k (1 .. 3000) {
+    print $sock "set cold$k 0 0 8000\r\n$value\r\n";
+    my $r = scalar <$sock>;
+    $res{$r}++;
+    $first_dropped = $k if !defined $first_dropped && $r eq "NOT_STORED\r\n";
+}
+is(join(",", sort keys %res), "NOT_STORED\r\n,STORED\r\n",
+    "sets were stored, then dropped");
+
+$stats = mem_stats($sock);
+cmp_ok($stats->{evictions}, '>', 0, "memory evicted");
+is($stats->{admission_rejected}, $res{"NOT_STORED\r\n"},
+    "every dropped key counted");
+cmp_ok($stats->{curr_items} * 8000, '<', 8 * 1024 * 1024,
+    "dropped keys are not counted as items");
+mem_get_is($sock, "cold$first_dropped", undef, "dropped key is not stored");
+
+# A key looked up often enough gets in.
+for (1 .. 10) {
+    mem_get_is($sock, "hot", undef);
+}
+print $sock "set hot 0 0 8000\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "popular key stored");
+mem_get_is($sock, "hot", $value);
+cmp_ok(mem_stats($sock)->{admission_admitted}, '>', 0, "admitted key counted");
+
+# Existing keys are replaced whatever the filter says.
+print $sock "set hot 0 0 1\r\n7\r\n";
+is(scalar <$sock>, "STORED\r\n", "replaced existing key");
+print $sock "incr hot 1\r\n";
+is(scalar <$sock>, "8\r\n", "incr existing key");
+print $sock "delete hot\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted existing key");
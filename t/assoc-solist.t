@@ -0,0 +1,63 @@
+#!/usr/bin/env perl
+
+use strict;
+use Test::More tests => 8;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached('-m 64 -o assoc_engine=solist,hashpower=13');
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock);
+my $power = $stats->{hash_power_level};
+is($power, 13, "hash power level set");
+is($stats->{hash_bytes}, 16 * 2**13, "one dummy node per bucket");
+
+sub check_all {
+    my ($n, $deleted, $msg) = @_;
+    my $bad = 0;
+    for my $k (1 .. $n) {
+        print $sock "get key$k\r\n";
+        my $l = <$sock>;
+        if ($deleted->($k)) {
+            $bad++ if $l ne "END\r\n";
+            next;
+        }
+        $bad++ unless $l eq "VALUE key$k 0 " . length($k) . "\r\n"
+            && scalar <$sock> eq "$k\r\n" && scalar <$sock> eq "END\r\n";
+    }
+    is($bad, 0, $msg);
+}
+
+# Enough keys for the table to expand while they are stored. New buckets
+# are split off the list in place, no key is ever out of reach.
+my $n = 50000;
+print $sock "set key$_ 0 0 " . length($_) . " noreply\r\n$_\r\n" for 1 .. $n;
+check_all($n, sub { 0 }, "all keys found");
+for (1 .. 20) {
+    last if mem_stats($sock)->{hash_power_level} > $power;
+    sleep 0.5;
+}
+cmp_ok(mem_stats($sock)->{hash_power_level}, '>', $power, "table expanded");
+check_all($n, sub { 0 }, "all keys found after expanding");
+
+# Unlinking every other node leaves the list whole.
+for (my $k = 1; $k <= $n; $k += 2) {
+    print $sock "delete key$k\r\n";
+    die "delete key$k failed" unless scalar <$sock> eq "DELETED\r\n";
+}
+check_all($n, sub { $_[0] % 2 }, "deleted keys gone, the rest found");
+is(mem_stats($sock)->{curr_items}, $n / 2, "curr_items counts the rest");
+
+# Evictions unlink their victims from the list, so a small cache keeps
+# finding room for new keys.
+$server = new_memcached('-m 8 -o assoc_engine=solist');
+$sock = $server->sock;
+my $value = "V" x 200;
+my $failed = 0;
+for my $k (1 .. 300000) {
+    print $sock "set key$k 0 0 200\r\n$value\r\n";
+    $failed++ if scalar <$sock> ne "STORED\r\n";
+}
+is($failed, 0, "all stored while evicting");
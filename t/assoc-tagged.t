@@ -0,0 +1,43 @@
+#!/usr/bin/env perl
+
+use strict;
+use Test::More tests => 8;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached('-m 64 -o assoc_engine=tagged,hashpower=13');
+my $sock = $server->sock;
+
+# Each bucket is one cache line: 7 tags, the meta byte and 7 item pointers.
+is(mem_stats($sock)->{hash_bytes}, 64 * 2**13, "one cache line per bucket");
+
+# More keys than the 7 slots of each bucket hold before the table expands.
+# Keys that fit in none of the buckets in reach displace others, the rest
+# must be found, in their home bucket or in the ones following it.
+my $n = 60000;
+print $sock "set key$_ 0 0 1 noreply\r\nx\r\n" for 1 .. $n;
+my $found = 0;
+for my $k (1 .. $n) {
+    print $sock "get key$k\r\n";
+    my $l = <$sock>;
+    next if $l eq "END\r\n";
+    $found++ if $l eq "VALUE key$k 0 1\r\n" && scalar <$sock> eq "x\r\n";
+    <$sock>;
+}
+cmp_ok($found, '>', $n * 0.9, "most keys found");
+cmp_ok($found, '<', $n, "keys displaced before the table expanded");
+cmp_ok(mem_stats($sock)->{hash_power_level}, '>', 13, "table expanded");
+
+# Displaced keys leave the cache like evicted ones.
+my $stats = mem_stats($sock);
+is($stats->{curr_items}, $found, "curr_items counts the keys found");
+is($stats->{evictions}, $n - $found, "displaced keys counted as evictions");
+
+my $deleted = 0;
+for my $k (1 .. $n) {
+    print $sock "delete key$k\r\n";
+    $deleted++ if scalar <$sock> eq "DELETED\r\n";
+}
+is($deleted, $found, "deleted the keys found");
+is(mem_stats($sock)->{curr_items}, 0, "no items left");
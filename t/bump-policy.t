@@ -0,0 +1,39 @@
+#!/usr/bin/env perl
+
+use strict;
+use Test::More tests => 27;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $hits = 200;
+
+# Every policy marks an item fetched on its first hit. Only always writes
+# the access time and CLOCK count on every hit, the others skip most.
+for my $policy (qw(always test interval sample)) {
+    my $server = new_memcached("-o bump_policy=$policy");
+    my $sock = $server->sock;
+
+    print $sock "set foo 0 0 3\r\nbar\r\n";
+    is(scalar <$sock>, "STORED\r\n", "$policy: stored foo");
+    print $sock "mg foo h\r\n";
+    is(scalar <$sock>, "HD h0\r\n", "$policy: not fetched yet");
+    mem_get_is($sock, "foo", "bar", "$policy: got foo");
+    print $sock "mg foo h\r\n";
+    is(scalar <$sock>, "HD h1\r\n", "$policy: first hit marks it fetched");
+
+    my $bad = 0;
+    for (1 .. $hits) {
+        print $sock "get foo\r\n";
+        $bad++ unless scalar <$sock> eq "VALUE foo 0 3\r\n"
+            && scalar <$sock> eq "bar\r\n" && scalar <$sock> eq "END\r\n";
+    }
+    is($bad, 0, "$policy: hits got foo");
+    my $skipped = mem_stats($sock)->{bumps_skipped};
+    if ($policy eq 'always') {
+        is($skipped, 0, "$policy: no bump skipped");
+    } else {
+        cmp_ok($skipped, '>', 0, "$policy: bumps skipped");
+        cmp_ok($skipped, '<=', $hits + 2, "$policy: only hits skip bumps");
+    }
+}
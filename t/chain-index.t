@@ -0,0 +1,56 @@
+#!/usr/bin/env perl
+
+use strict;
+use Test::More tests => 8;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# Lookups that walk long hash chains index them, and
+# deletes of indexed items must not leave lookups starting from them.
+my $server = new_memcached('-m 64 -o hashpower=13,no_hashexpand,chain_index_len=2');
+my $sock = $server->sock;
+
+# About 5 items per bucket, every lookup walks past the limit.
+my $n = 40000;
+for my $k (1 .. $n) {
+    print $sock "set key$k 0 0 " . length($k) . "\r\n$k\r\n";
+    die "set key$k failed" unless scalar <$sock> eq "STORED\r\n";
+}
+
+sub check_all {
+    my ($deleted, $msg) = @_;
+    my $bad = 0;
+    for my $k (1 .. $n) {
+        my $want = $deleted->($k) ? undef : $k;
+        print $sock "get key$k\r\n";
+        my $l = <$sock>;
+        my $got;
+        if ($l ne "END\r\n") {
+            $got = <$sock>;
+            chomp $got; chop $got;
+            <$sock>;
+        }
+        $bad++ if (defined $got) != (defined $want)
+            || (defined $got && $got ne $want);
+    }
+    is($bad, 0, $msg);
+}
+
+check_all(sub { 0 }, "all keys found");
+cmp_ok(mem_stats($sock)->{hash_chain_indexes}, '>', 0, "long chains indexed");
+
+# Deleting indexed items leaves their indexes unused until rebuilt.
+for (my $k = 1; $k <= $n; $k += 3) {
+    print $sock "delete key$k\r\n";
+    die "delete key$k failed" unless scalar <$sock> eq "DELETED\r\n";
+}
+check_all(sub { $_[0] % 3 == 1 }, "deleted keys gone, the rest found");
+check_all(sub { $_[0] % 3 == 1 }, "again, through rebuilt indexes");
+
+print $sock "incr key2 10\r\n";
+is(scalar <$sock>, "12\r\n", "incr in an indexed chain");
+mem_get_is($sock, "key2", "12");
+print $sock "set key1 0 0 3\r\nnew\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored a deleted key again");
+mem_get_is($sock, "key1", "new");
@@ -0,0 +1,83 @@
+#!/usr/bin/env perl
+
+use strict;
+use Test::More tests => 13;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $value = "V" x 8000;
+
+# Stores more than fits and returns the stats.
+sub fill {
+    my ($sock, $name) = @_;
+    my $n = 3000;
+    my $failed = 0;
+    for my $k (1 .. $n) {
+        print $sock "set key$k 0 0 8000\r\n$value\r\n";
+        $failed++ if scalar <$sock> ne "STORED\r\n";
+    }
+    is($failed, 0, "$name: all stored");
+
+    my ($found, $bad) = (0, 0);
+    for my $k (1 .. $n) {
+        print $sock "get key$k\r\n";
+        my $l = <$sock>;
+        next if $l eq "END\r\n";
+        my $v;
+        read($sock, $v, 8002);
+        <$sock>;
+        $found++;
+        $bad++ if $l ne "VALUE key$k 0 8000\r\n" || $v ne "$value\r\n";
+    }
+    is($bad, 0, "$name: values intact");
+    my $stats = mem_stats($sock);
+    is($stats->{evictions}, $n - $found, "$name: evictions count the keys gone");
+    return $stats;
+}
+
+# Free chunks of the class the keys are stored in.
+sub free_chunks {
+    my $sock = shift;
+    my $slabs = mem_stats($sock, 'slabs');
+    my ($free, $used) = (0, 0);
+    for my $k (keys %$slabs) {
+        next unless $k =~ /^(\d+):used_chunks$/ && $slabs->{$k} > $used;
+        $used = $slabs->{$k};
+        $free = $slabs->{"$1:free_chunks"};
+    }
+    return $free;
+}
+
+# The evictor keeps a quarter of a page free in the class that ran out.
+{
+    my $server = new_memcached('-m 8 -o evictor_low_wm=25,evictor_high_wm=50');
+    my $sock = $server->sock;
+    my $stats = fill($sock, "evictor");
+    cmp_ok($stats->{evictor_evictions}, '>', 0, "evictor: background thread evicted");
+    is($stats->{evictor_evictions} + $stats->{direct_evictions}, $stats->{evictions},
+        "evictor: every eviction counted once");
+    cmp_ok(free_chunks($sock), '>', 0, "evictor: free chunks kept");
+}
+
+# Without it every eviction is made by the store that needs the chunk.
+{
+    my $server = new_memcached('-m 8 -o evictor_low_wm=0');
+    my $sock = $server->sock;
+    my $stats = fill($sock, "no evictor");
+    is($stats->{evictor_evictions}, 0, "no evictor: background thread idle");
+    cmp_ok($stats->{direct_evictions}, '>', 0, "no evictor: stores evicted");
+}
+
+# With -M nothing is evicted, not even by the evictor: stores fail instead.
+{
+    my $server = new_memcached('-M -m 8 -o evictor_low_wm=25,evictor_high_wm=50');
+    my $sock = $server->sock;
+    my $oom = 0;
+    for my $k (1 .. 3000) {
+        print $sock "set key$k 0 0 8000\r\n$value\r\n";
+        $oom++ if scalar <$sock> =~ /^SERVER_ERROR out of memory/;
+    }
+    cmp_ok($oom, '>', 0, "-M: stores ran out of memory");
+    is(mem_stats($sock)->{evictions}, 0, "-M: nothing evicted");
+}
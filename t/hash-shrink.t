@@ -0,0 +1,62 @@
+#!/usr/bin/env perl
+
+use strict;
+use Test::More tests => 10;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# The hash table halves back towards its starting size
+# once it holds few items. Off by default.
+{
+    my $server = new_memcached();
+    my $sock = $server->sock;
+    is(mem_stats($sock, 'settings')->{hash_shrink_pct}, 0, "shrinking off by default");
+}
+
+my $server = new_memcached('-m 64 -o hashpower=13,hash_shrink_pct=10');
+my $sock = $server->sock;
+
+sub wait_power {
+    my ($cmp, $power) = @_;
+    for (1 .. 30) {
+        my $p = mem_stats($sock)->{hash_power_level};
+        return $p if ($cmp eq '>' ? $p > $power : $p == $power)
+            && !mem_stats($sock)->{hash_is_expanding};
+        sleep 0.5;
+    }
+    return mem_stats($sock)->{hash_power_level};
+}
+
+my $n = 30000;
+for my $k (1 .. $n) {
+    print $sock "set key$k 0 0 " . length($k) . "\r\n$k\r\n";
+    die "set key$k failed" unless scalar <$sock> eq "STORED\r\n";
+}
+cmp_ok(wait_power('>', 13), '>', 13, "table expanded");
+
+# Keep a few keys, the table is then mostly empty.
+for my $k (101 .. $n) {
+    print $sock "delete key$k\r\n";
+    die "delete key$k failed" unless scalar <$sock> eq "DELETED\r\n";
+}
+is(mem_stats($sock)->{curr_items}, 100, "100 keys left");
+is(wait_power('==', 13), 13, "table shrank back to its starting size");
+
+my $bad = 0;
+for my $k (1 .. 100) {
+    print $sock "get key$k\r\n";
+    $bad++ unless scalar <$sock> eq "VALUE key$k 0 " . length($k) . "\r\n";
+    $bad++ unless scalar <$sock> eq "$k\r\n";
+    $bad++ unless scalar <$sock> eq "END\r\n";
+}
+is($bad, 0, "keys left found after shrinking");
+mem_get_is($sock, "key101", undef, "deleted key gone");
+
+print $sock "incr key5 5\r\n";
+is(scalar <$sock>, "10\r\n", "incr after shrinking");
+print $sock "set key101 0 0 3\r\nnew\r\n";
+is(scalar <$sock>, "STORED\r\n", "set after shrinking");
+mem_get_is($sock, "key101", "new");
+print $sock "delete key1\r\n";
+is(scalar <$sock>, "DELETED\r\n", "delete after shrinking");
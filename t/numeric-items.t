@@ -0,0 +1,96 @@
+#!/usr/bin/env perl
+
+use strict;
+use Test::More tests => 31;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# Numeric items: incr/decr update them in place, other commands see them as
+# their rendered value. Deltas given a CAS apply only if it still matches.
+my $server = new_memcached('-t 4');
+my $sock = $server->sock;
+
+print $sock "set n 0 0 1\r\n5\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored n");
+print $sock "incr n 3\r\n";
+is(scalar <$sock>, "8\r\n", "first incr replaces it with a numeric item");
+print $sock "incr n 2\r\n";
+is(scalar <$sock>, "10\r\n", "next incr is in place");
+print $sock "decr n 20\r\n";
+is(scalar <$sock>, "0\r\n", "decr stops at 0");
+print $sock "incr n 9\r\n";
+is(scalar <$sock>, "9\r\n", "incr from 0");
+
+# gets/cas see the CAS of the in place updates.
+my ($cas1, $val) = mem_gets($sock, "n");
+is($val, "9", "gets numeric value");
+print $sock "incr n 1\r\n";
+is(scalar <$sock>, "10\r\n", "incr after gets");
+my ($cas2) = mem_gets($sock, "n");
+isnt($cas2, $cas1, "incr changed the CAS");
+print $sock "cas n 0 0 1 $cas1\r\n7\r\n";
+is(scalar <$sock>, "EXISTS\r\n", "cas with the CAS before incr fails");
+print $sock "cas n 0 0 2 $cas2\r\n42\r\n";
+is(scalar <$sock>, "STORED\r\n", "cas with the current CAS");
+mem_get_is($sock, "n", "42");
+
+# append/prepend work from the rendered value.
+print $sock "incr n 1\r\n";
+is(scalar <$sock>, "43\r\n", "incr again");
+print $sock "append n 0 0 2\r\n00\r\n";
+is(scalar <$sock>, "STORED\r\n", "appended to numeric item");
+mem_get_is($sock, "n", "4300");
+print $sock "incr n 1\r\n";
+is(scalar <$sock>, "4301\r\n", "incr appended value");
+print $sock "prepend n 0 0 1\r\n1\r\n";
+is(scalar <$sock>, "STORED\r\n", "prepended to numeric item");
+mem_get_is($sock, "n", "14301");
+print $sock "delete n\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted numeric item");
+print $sock "incr n 1\r\n";
+is(scalar <$sock>, "NOT_FOUND\r\n", "incr after delete");
+
+# Concurrent in place increments from several connections add up.
+print $sock "set c 0 0 1\r\n0\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored counter");
+print $sock "incr c 0\r\n";
+is(scalar <$sock>, "0\r\n", "counter is numeric");
+my @socks = map { $server->new_sock } 1 .. 4;
+my $per = 500;
+print $_ "incr c 1\r\n" x $per for @socks;
+for my $s (@socks) {
+    <$s> for 1 .. $per;
+}
+mem_get_is($sock, "c", 4 * $per, "no increment lost");
+
+# Of the deltas given the same CAS, only one applies.
+my $rounds = 200;
+my $cas;
+my %res = ();
+for (1 .. $rounds) {
+    print $sock "mg c c\r\n";
+    ($cas) = (scalar <$sock>) =~ /^HD c(\d+)/;
+    print $_ "ma c C$cas\r\n" for @socks;
+    $res{scalar readline($_)}++ for @socks;
+}
+is($res{"HD\r\n"}, $rounds, "one delta with the CAS applied per round");
+is($res{"EX\r\n"}, 3 * $rounds, "the others failed");
+mem_get_is($sock, "c", 4 * $per + $rounds);
+
+# Of the cas commands racing with the same CAS, only one stores.
+($cas) = mem_gets($sock, "c");
+print $_ "cas c 0 0 1 $cas\r\n9\r\n" for @socks;
+%res = ();
+$res{scalar readline($_)}++ for @socks;
+is($res{"STORED\r\n"}, 1, "one cas stored");
+is($res{"EXISTS\r\n"}, 3, "the others failed");
+mem_get_is($sock, "c", "9");
+
+# cas loses to a replace in between.
+($cas) = mem_gets($sock, "c");
+print $sock "set c 0 0 1\r\n1\r\n";
+is(scalar <$sock>, "STORED\r\n", "replaced counter");
+print $sock "cas c 0 0 1 $cas\r\n2\r\n";
+is(scalar <$sock>, "EXISTS\r\n", "cas after a replace fails");
+mem_get_is($sock, "c", "1");
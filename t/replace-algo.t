@@ -0,0 +1,47 @@
+#!/usr/bin/env perl
+
+use strict;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# Keys are replaced over and over while other connections read them. With
+# posterior and mark the new item is in the chain before the old one
+# leaves it, lookups find either version. With none a lookup can land in
+# between and miss the key, but never finds a torn value.
+for my $algo (qw(posterior mark none)) {
+    my $server = new_memcached("-t 4 -o replace_algo=$algo");
+    my $sock = $server->sock;
+
+    my @keys = map { "key$_" } 1 .. 50;
+    print $sock "set $_ 0 0 1\r\n0\r\n" for @keys;
+    <$sock> for @keys;
+    my @readers = map { $server->new_sock } 1 .. 3;
+    my $rounds = 40;
+    print $_ join("", map { "get $_\r\n" } (@keys) x $rounds) for @readers;
+    for my $r (1 .. $rounds) {
+        my $v = $r % 10;
+        print $sock "set $_ 0 0 1 noreply\r\n$v\r\n" for @keys;
+    }
+    my $missed = 0;
+    my $bad = 0;
+    for my $rs (@readers) {
+        for my $k ((@keys) x $rounds) {
+            my $l = <$rs>;
+            if ($l eq "END\r\n") {
+                $missed++;
+                next;
+            }
+            $bad++ unless $l eq "VALUE $k 0 1\r\n" && scalar <$rs> =~ /^\d\r\n$/;
+            <$rs>;
+        }
+    }
+    is($bad, 0, "$algo: lookups found whole values");
+    is($missed, 0, "$algo: no lookup missed a replaced key") unless $algo eq 'none';
+    mem_get_is($sock, "key1", ($rounds % 10), "$algo: last value stored");
+
+    my $stats = mem_stats($sock);
+    ok(defined $stats->{replace_retries}, "$algo: replace_retries reported");
+    is($stats->{curr_items}, scalar @keys, "$algo: replaced items unlinked");
+}
@@ -0,0 +1,61 @@
+#!/usr/bin/env perl
+
+use strict;
+use Test::More tests => 12;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $value = "V" x 8000;
+
+for my $args ('', '-C') {
+    my $name = $args ? "sieve $args" : "sieve";
+    my $server = new_memcached("-m 8 $args -o evict_algo=sieve");
+    my $sock = $server->sock;
+
+    # Chunked items are linked through their header's class.
+    my $big = "B" x (1024 * 1024 - 100);
+    print $sock "set big 0 0 " . length($big) . "\r\n$big\r\n";
+    is(scalar <$sock>, "STORED\r\n", "$name: stored chunked item");
+    mem_get_is($sock, "big", $big, "$name: got chunked item");
+    print $sock "delete big\r\n";
+    is(scalar <$sock>, "DELETED\r\n", "$name: deleted chunked item");
+
+    # Keys read between the stores are passed over by the hand, the ones
+    # never read are evicted in the order they were stored.
+    my @hot = map { "hot$_" } 1 .. 20;
+    print $sock "set $_ 0 0 8000\r\n$value\r\n" for @hot;
+    <$sock> for @hot;
+    my $n = 3000;
+    for my $k (1 .. $n) {
+        if ($k % 100 == 0) {
+            print $sock "get $_\r\n" for @hot;
+            for (@hot) {
+                next if scalar <$sock> eq "END\r\n";
+                <$sock>;
+                <$sock>;
+            }
+        }
+        print $sock "set cold$k 0 0 8000\r\n$value\r\n";
+        <$sock>;
+    }
+
+    my $hot = 0;
+    for my $k (@hot) {
+        print $sock "mg $k\r\n";
+        $hot++ if scalar <$sock> eq "HD\r\n";
+    }
+    is($hot, scalar @hot, "$name: keys read were kept");
+
+    my ($first_found, $last_missed) = (0, 0);
+    for my $k (1 .. $n) {
+        print $sock "mg cold$k\r\n";
+        if (scalar <$sock> eq "HD\r\n") {
+            $first_found ||= $k;
+        } else {
+            $last_missed = $k;
+        }
+    }
+    cmp_ok($last_missed, '>', 0, "$name: keys never read evicted");
+    cmp_ok($last_missed, '<', $first_found, "$name: oldest keys evicted first");
+}
@@ -0,0 +1,53 @@
+#!/usr/bin/env perl
+
+use strict;
+use Test::More tests => 4;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# A client that stops reading keeps the items its queued responses send
+# from, but must not keep memory from being reused for other items.
+my $server = new_memcached('-m 8 -t 2');
+my $slow = $server->sock;
+my $sock = $server->new_sock;
+
+my $old = "B" x 500000;
+print $sock "set big 0 0 500000\r\n$old\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored big value");
+
+# Queue up more than the socket buffers hold, without reading.
+my $gets = 40;
+print $slow "get big\r\n" x $gets;
+sleep 1;
+
+# Replacing it many times over the memory limit needs the memory of the
+# replaced values back, all but the one the queued responses send from.
+my $new = "C" x 500000;
+my $failed = 0;
+for (1 .. 40) {
+    print $sock "set big 0 0 500000\r\n$new\r\n";
+    $failed++ if scalar <$sock> ne "STORED\r\n";
+}
+is($failed, 0, "replaced big value while a client stalled");
+
+# Gets the server had not read yet see the new value, none may see a mix.
+my %seen = (old => 0, new => 0, bad => 0);
+for (1 .. $gets) {
+    my $hdr = <$slow>;
+    last unless defined $hdr && $hdr eq "VALUE big 0 500000\r\n";
+    my $body;
+    read($slow, $body, 500000 + 2);
+    my $end = <$slow>;
+    if ($end ne "END\r\n") {
+        $seen{bad}++;
+    } elsif ($body eq "$old\r\n") {
+        $seen{old}++;
+    } elsif ($body eq "$new\r\n") {
+        $seen{new}++;
+    } else {
+        $seen{bad}++;
+    }
+}
+is($seen{old} + $seen{new}, $gets, "queued responses were sent intact");
+cmp_ok($seen{old}, '>', 0, "some were queued before the value was replaced");
@@ -27,6 +27,7 @@
 #endif
 
 #include "ebr.h"
+#include "nblist.h"
 
 #define ITEMS_PER_ALLOC 64
 
@@ -462,6 +463,8 @@ static void setup_thread(LIBEVENT_THREAD *me) {
 //TODO: make this cleaner/nicer/in the correct spot
 __thread int tid;
 __thread reclamation* recl;
+__thread bool ebr_in_command = false;
+__thread int ebr_batch_commands = 0;
 #define LIMBO_BAG_SIZE 100
 
 static void *worker_libevent(void *arg) {
@@ -484,7 +487,10 @@ static void *worker_libevent(void *arg) {
 
     register_thread_initialized();
 
-    event_base_loop(me->base, 0);
+    //One iteration at a time, to be quiescent while waiting for events
+    while (event_base_loop(me->base, EVLOOP_ONCE) == 0 && !event_base_got_exit(me->base))
+        ebr_end_batch();
+    ebr_end_batch();
 
     // same mechanism used to watch for all threads exiting.
     register_thread_initialized();
@@ -793,6 +799,18 @@ item *item_get(const char *key, const size_t nkey, LIBEVENT_THREAD *t, const boo
     return it;
 }
 
+/*
+ * item_get for n keys, hashed first and then looked up together.
+ */
+void item_get_batch(const char **keys, const size_t *nkeys, const int n, LIBEVENT_THREAD *t, const bool do_update, item **its) {
+    uint32_t hvs[n];
+
+    for (int i = 0; i < n; i++) {
+        hvs[i] = hash(keys[i], nkeys[i]);
+    }
+    do_item_get_batch(keys, nkeys, hvs, n, t, do_update, its);
+}
+
 // returns an item with the item lock held.
 // lock will still be held even if return is NULL, allowing caller to replace
 // an item atomically if desired.
@@ -816,12 +834,7 @@ item *item_touch(const char *key, size_t nkey, uint32_t exptime, LIBEVENT_THREAD
  * Links an item into the LRU and hashtable.
  */
 int item_link(item *item) {
-    int ret;
-    uint32_t hv;
-
-    hv = hash(ITEM_key(item), item->nkey);
-    ret = do_item_link(item, hv);
-    return ret;
+    return do_item_link(item, item->hv);
 }
 
 /*
@@ -844,13 +857,19 @@ int item_replace(item *old_it, item *new_it, const uint32_t hv) {
     return do_item_replace(old_it, new_it, hv);
 }
 
+/*
+ * Replaces an item with another, unless it was replaced or unlinked since
+ * it was looked up.
+ */
+int item_replace_if(item *old_it, item *new_it, const uint32_t hv) {
+    return do_item_replace_if(old_it, new_it, hv);
+}
+
 /*
  * Unlinks an item from the LRU and hashtable.
  */
 void item_unlink(item *item) {
-    uint32_t hv;
-    hv = hash(ITEM_key(item), item->nkey);
-    do_item_unlink(item, hv);
+    do_item_unlink(item, item->hv);
 }
 
 /*
@@ -872,12 +891,7 @@ enum delta_result_type add_delta(LIBEVENT_THREAD *t, const char *key,
  * Stores an item in the cache (high level, obeys set/add/replace semantics)
  */
 enum store_item_type store_item(item *item, int comm, LIBEVENT_THREAD *t, uint64_t *cas, bool cas_stale) {
-    enum store_item_type ret;
-    uint32_t hv;
-
-    hv = hash(ITEM_key(item), item->nkey);
-    ret = do_store_item(item, comm, t, hv, cas, cas_stale);
-    return ret;
+    return do_store_item(item, comm, t, item->hv, cas, cas_stale);
 }
 
 /******************************* GLOBAL STATS ******************************/
@@ -1007,8 +1021,8 @@ void memcached_thread_init(int nthreads, void *arg) {
         exit(1);
     }
 
-    //Start ebr for each thread + assoc maintenance thread
-    r = init_ebr(nthreads + 1, &reclaim_item);
+    //Start ebr for each thread + the hash table's threads
+    r = init_ebr(nthreads + ASSOC_THREADS, &reclaim_item, &reclaim_items);
 
     if (start_assoc_maintenance_thread(r) == -1) {
     //Ignore disabling assoc maint, for simplicity
@@ -1016,6 +1030,10 @@ void memcached_thread_init(int nthreads, void *arg) {
         exit(EXIT_FAILURE);
     }
 
+    if (settings.evictor_low_wm > 0 && start_assoc_evictor_thread(r) == -1) {
+        exit(EXIT_FAILURE);
+    }
+
     
     for (i = 0; i < nthreads; i++) {
 #ifdef HAVE_EVENTFD